@@ -0,0 +1,391 @@
+// cadsh_bench: times cadsh's mesh import on generated files.
+//
+// Usage: cadsh_bench 3mf|stl [triangles]
+//
+// The test meshes are generated, written to a temporary file in the current
+// directory with the matching exporter and read back.  Each import is run a
+// few times and the best time kept.  Where fork() is available, each STL
+// import runs in a child process so its peak resident memory can be told
+// apart from the others'.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+#include "manifoldIO.h"
+#include "weldkey.h"
+
+static const int runs = 3;
+
+// torus grid of about the requested triangle count, u segments around the
+// ring and v around the tube, two triangles per grid cell:
+static void TorusGrid(size_t triangles, size_t& u, size_t& v)
+{
+	u = std::max<size_t>(3, (size_t) std::sqrt(triangles / 2.0));
+	v = std::max<size_t>(3, triangles / (2 * u));
+}
+
+static manifold::MeshGL TorusMesh(size_t triangles)
+{
+	size_t u, v;
+	TorusGrid(triangles, u, v);
+
+	manifold::MeshGL mesh;
+	mesh.numProp = 3;
+	mesh.vertProperties.reserve(u * v * 3);
+	mesh.triVerts.reserve(u * v * 6);
+	const double pi = 3.14159265358979323846;
+	for (size_t i=0; i<u; i++) {
+		double a = 2 * pi * i / u;
+		for (size_t j=0; j<v; j++) {
+			double b = 2 * pi * j / v;
+			double r = 10.0 + 3.0 * std::cos(b);
+			mesh.vertProperties.push_back(r * std::cos(a));
+			mesh.vertProperties.push_back(r * std::sin(a));
+			mesh.vertProperties.push_back(3.0 * std::sin(b));
+		}
+	}
+	for (size_t i=0; i<u; i++) {
+		size_t i1 = (i + 1) % u;
+		for (size_t j=0; j<v; j++) {
+			size_t j1 = (j + 1) % v;
+			uint32_t a = i * v + j, b = i1 * v + j, c = i1 * v + j1, d = i * v + j1;
+			mesh.triVerts.insert(mesh.triVerts.end(), {a, b, c});
+			mesh.triVerts.insert(mesh.triVerts.end(), {a, c, d});
+		}
+	}
+	return mesh;
+}
+
+static size_t TorusTriangles(size_t triangles)
+{
+	size_t u, v;
+	TorusGrid(triangles, u, v);
+	return u * v * 2;
+}
+
+// a cube of side s millimetres, each face tessellated into 1mm squares: every
+// coordinate a whole number, like the grid-aligned output of CAD tools.  The
+// faces don't share vertices, the weld joins them (6s^2+2 vertices):
+static size_t BoxSide(size_t triangles)
+{
+	return std::max<size_t>(1, (size_t) std::sqrt(triangles / 12.0));
+}
+
+static manifold::MeshGL BoxMesh(size_t triangles)
+{
+	const size_t s = BoxSide(triangles), n = s + 1;
+	manifold::MeshGL mesh;
+	mesh.numProp = 3;
+	for (int a=0; a<3; a++) {
+		const int b = (a + 1) % 3, c = (a + 2) % 3;
+		for (size_t side : {(size_t) 0, s}) {
+			const uint32_t base = mesh.vertProperties.size() / 3;
+			for (size_t i=0; i<n; i++)
+				for (size_t j=0; j<n; j++) {
+					float p[3];
+					p[a] = side;
+					p[b] = i;
+					p[c] = j;
+					mesh.vertProperties.insert(mesh.vertProperties.end(), p, p + 3);
+				}
+			for (uint32_t i=0; i<s; i++)
+				for (uint32_t j=0; j<s; j++) {
+					uint32_t v00 = base + i * n + j, v10 = v00 + n, v11 = v10 + 1, v01 = v00 + 1;
+					if (side)  // outward +a: b then c is counterclockwise
+						mesh.triVerts.insert(mesh.triVerts.end(), {v00, v10, v11, v00, v11, v01});
+					else
+						mesh.triVerts.insert(mesh.triVerts.end(), {v00, v11, v10, v00, v01, v11});
+				}
+		}
+	}
+	return mesh;
+}
+
+static size_t BoxTriangles(size_t triangles)
+{
+	const size_t s = BoxSide(triangles);
+	return 12 * s * s;
+}
+
+// best wall time of runs calls, in seconds:
+static double Best(std::function<void()> f)
+{
+	double best = 1e30;
+	for (int r=0; r<runs; r++) {
+		auto t0 = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+		best = std::min(best, d.count());
+	}
+	return best;
+}
+
+// 3MF: the import is timed end to end, then the Manifold construction from
+// the same MeshGL alone; the difference is the cost of inflating and
+// parsing the model document, reported per <vertex>/<triangle> element.
+static int Bench3MF(size_t triangles)
+{
+	manifold::MeshGL mesh = TorusMesh(triangles);
+	size_t nv = mesh.NumVert(), nt = mesh.NumTri();
+	std::string file = "cadsh_bench.3mf";
+	if (!ExportMeshGL3MF(file, mesh)) {
+		fprintf(stderr, "3mf: can't write %s\n", file.c_str());
+		return 1;
+	}
+
+	size_t got = 0;
+	double total = Best([&]() {
+		std::vector<manifold::Manifold> m = ImportMeshes3MF(file);
+		got = m.empty() ? 0 : m[0].NumTri();
+	});
+	double build = Best([&]() { manifold::Manifold m(mesh); });
+	remove(file.c_str());
+	if (got != nt) {
+		fprintf(stderr, "3mf: read %zu triangles, wrote %zu\n", got, nt);
+		return 1;
+	}
+
+	double parse = std::max(0.0, total - build);
+	printf("3mf: %zu vertices, %zu triangles\n", nv, nt);
+	printf("  import   %8.3f s\n", total);
+	printf("  manifold %8.3f s\n", build);
+	printf("  parse    %8.3f s  %6.1f ns/element\n", parse, parse * 1e9 / (nv + nt));
+	return 0;
+}
+
+// runs f, in a child process where fork() is available, and sets peak to
+// the child's peak resident memory in MB (ru_maxrss is KB on Linux, bytes
+// on macOS), -1 where it can't be had; returns f's status:
+static int Measure(std::function<int()> f, double& peak)
+{
+	peak = -1;
+#ifdef _WIN32
+	return f();
+#else
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) return f();
+	if (pid == 0) {
+		int status = f();
+		fflush(stdout);
+		_exit(status);
+	}
+	int status;
+	struct rusage child;
+	if (wait4(pid, &status, 0, &child) < 0 || !WIFEXITED(status)) return 1;
+#ifdef __APPLE__
+	const double mb = 1024.0 * 1024.0;
+#else
+	const double mb = 1024.0;
+#endif
+	peak = child.ru_maxrss / mb;
+	return WEXITSTATUS(status);
+#endif
+}
+
+// the weld key hash the flat tables replaced, XOR of products.  Its low bits
+// are those of the keys: coordinates on a millimetre grid quantize (at the
+// default weld of 1e-5) to multiples of 100000 = 2^5 * 3125, so the low five
+// bits are zero for every key, and a table indexed by them uses a 32nd of its
+// slots:
+struct XorHash {
+	size_t operator()(const QuantizedVec3& q) const noexcept {
+		return (size_t) q.x * 73856093u ^ (size_t) q.y * 19349663u ^ (size_t) q.z * 83492791u;
+	}
+};
+
+// the mesh's triangle corners in file order, quantized as the STL weld does:
+static std::vector<QuantizedVec3> CornerKeys(const manifold::MeshGL& mesh, float eps)
+{
+	std::vector<QuantizedVec3> keys(mesh.triVerts.size());
+	for (size_t i=0; i<keys.size(); i++) {
+		const float *p = &mesh.vertProperties[(size_t) mesh.triVerts[i] * mesh.numProp];
+		keys[i] = Quantize({p[0], p[1], p[2]}, eps);
+	}
+	return keys;
+}
+
+// the STL weld's dedup on its own: a flat table of 32-byte slots probed
+// linearly from the hash's low bits, sized as the streaming weld sizes its
+// table, a slot per triangle, doubling when half full.  Returns the vertex
+// count and sets probes to the slots looked at per corner:
+template<class H>
+static size_t FlatWeld(const std::vector<QuantizedVec3>& keys, double& probes)
+{
+	struct Slot { QuantizedVec3 key; uint32_t corner; };
+	const uint32_t empty = 0xFFFFFFFF;
+	size_t size = 16;
+	while (size < keys.size() / 3) size *= 2;
+	std::vector<Slot> table(size, Slot{{0, 0, 0}, empty});
+	size_t unique = 0, looked = 0;
+	for (size_t i=0; i<keys.size(); i++) {
+		size_t mask = table.size() - 1;
+		size_t h = H()(keys[i]) & mask;
+		looked++;
+		while (table[h].corner != empty && !(table[h].key == keys[i])) {
+			h = (h + 1) & mask;
+			looked++;
+		}
+		if (table[h].corner != empty) continue;
+		table[h] = Slot{keys[i], (uint32_t) i};
+		if (++unique * 2 > table.size()) {
+			std::vector<Slot> old(table.size() * 2, Slot{{0, 0, 0}, empty});
+			old.swap(table);
+			mask = table.size() - 1;
+			for (const Slot& o : old) {
+				if (o.corner == empty) continue;
+				h = H()(o.key) & mask;
+				while (table[h].corner != empty) h = (h + 1) & mask;
+				table[h] = o;
+			}
+		}
+	}
+	probes = (double) looked / keys.size();
+	return unique;
+}
+
+// the weld as it was: a node per vertex in std::unordered_map, old hash:
+static size_t MapWeld(const std::vector<QuantizedVec3>& keys)
+{
+	std::unordered_map<QuantizedVec3, uint32_t, XorHash> map;
+	for (size_t i=0; i<keys.size(); i++)
+		map.emplace(keys[i], (uint32_t) i);
+	return map.size();
+}
+
+struct Input {
+	const char *name;
+	size_t (*triangles)(size_t);  //the count generated for the one asked for
+	manifold::MeshGL (*mesh)(size_t);
+};
+
+// STL: for each input, the binary file is imported with the default weld, the
+// exact (eps 0) weld, and the streaming weld.  The parallel weld holds two
+// uint32 arrays per corner plus one partition's hash table per thread,
+// 32-byte slots at most half full; the streaming weld holds one table of
+// 8-byte slots, doubling when half full, and no per-corner arrays.  The
+// peak includes the mapped file's pages (50 bytes a triangle) and the
+// resulting MeshGL; the parent's own, taken before any import, is shown
+// for reference.  Then the dedup alone is timed on the quantized corners:
+// the old unordered_map with the XOR hash, and a flat table with the XOR
+// hash and with the mixing hash, side by side.
+static int BenchSTL(size_t triangles)
+{
+	const Input inputs[] = {
+		{"torus", TorusTriangles, TorusMesh},
+		{"box (1mm grid)", BoxTriangles, BoxMesh}
+	};
+	std::string file = "cadsh_bench.stl";
+	const float eps = ImportSTLOptions().weld;
+	double peak;
+	int status = 0;
+
+	for (const Input& in : inputs) {
+		const size_t nt = in.triangles(triangles);
+
+		// the mesh is built and written in a child, so the parent stays small:
+		status = Measure([&]() {
+			manifold::MeshGL mesh = in.mesh(triangles);
+			if (!ExportMeshSTL(file, mesh)) {
+				fprintf(stderr, "stl: can't write %s\n", file.c_str());
+				return 1;
+			}
+			return 0;
+		}, peak);
+		if (status) break;
+
+#ifndef _WIN32
+		struct rusage self;
+		getrusage(RUSAGE_SELF, &self);
+#ifdef __APPLE__
+		const double base = self.ru_maxrss / (1024.0 * 1024.0);
+#else
+		const double base = self.ru_maxrss / 1024.0;
+#endif
+		printf("stl: %s, %zu triangles, parent %.1f MB\n", in.name, nt, base);
+#else
+		printf("stl: %s, %zu triangles\n", in.name, nt);
+#endif
+
+		struct Mode { const char *name; ImportSTLOptions opt; };
+		ImportSTLOptions exact, stream;
+		exact.weld = 0.0f;
+		stream.stream = true;
+		const Mode modes[] = { {"weld", ImportSTLOptions()}, {"exact", exact}, {"stream", stream} };
+
+		for (const Mode& m : modes) {
+			status = Measure([&]() {
+				size_t nv = 0, got = 0;
+				double t = Best([&]() {
+					manifold::MeshGL mesh = ImportMeshSTL(file, m.opt);
+					nv = mesh.NumVert();
+					got = mesh.NumTri();
+				});
+				if (got != nt) {
+					fprintf(stderr, "stl: %s read %zu triangles, wrote %zu\n", m.name, got, nt);
+					return 1;
+				}
+				printf("  %-12s %8.3f s  %6.1f ns/triangle, %zu vertices", m.name, t, t * 1e9 / nt, nv);
+				return 0;
+			}, peak);
+			if (peak >= 0) printf(", peak %.1f MB", peak);
+			printf("\n");
+			if (status) break;
+		}
+		remove(file.c_str());
+		if (status) break;
+
+		// the dedup alone, one thread, on the same corners:
+		struct Table { const char *name; std::function<size_t(const std::vector<QuantizedVec3>&, double&)> weld; };
+		const Table tables[] = {
+			{"map, xor", [](const std::vector<QuantizedVec3>& k, double& probes) { probes = -1; return MapWeld(k); }},
+			{"flat, xor", FlatWeld<XorHash>},
+			{"flat, mix", FlatWeld<QuantizedHash>}
+		};
+		for (const Table& tb : tables) {
+			status = Measure([&]() {
+				std::vector<QuantizedVec3> keys = CornerKeys(in.mesh(triangles), eps);
+				size_t nv = 0;
+				double probes = 0;
+				double t = Best([&]() { nv = tb.weld(keys, probes); });
+				printf("  %-12s %8.3f s  %6.1f ns/corner, %zu vertices", tb.name, t, t * 1e9 / keys.size(), nv);
+				if (probes >= 0) printf(", %.2f probes/corner", probes);
+				return 0;
+			}, peak);
+			if (peak >= 0) printf(", peak %.1f MB", peak);
+			printf("\n");
+			if (status) break;
+		}
+		if (status) break;
+	}
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: cadsh_bench 3mf|stl [triangles]\n");
+		return 1;
+	}
+	std::string mode = argv[1];
+	size_t triangles = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+
+	if (mode == "3mf") return Bench3MF(triangles);
+	if (mode == "stl") return BenchSTL(triangles);
+
+	fprintf(stderr, "cadsh_bench: unknown mode %s\n", mode.c_str());
+	return 1;
+}
@@ -3,6 +3,14 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <cmath>
 
 #include "manifold/manifold.h"
 //#include "meshIO.h"
@@ -10,12 +18,12 @@
 #include "mathparser.h"
 //#include "heightmap.h"
 #include "manifold_tidbits.h"
+#include "parallel.h"
 
 static std::vector<manifold::Manifold> m;
 static bool verbose = false;
 static bool all = false;
-
-//use this to parse out command specs: grep "//cmd" ../src/cadsh.cpp | awk -F'//cmd' '{printf "cout << \"\t"$2 "\" << endl << endl;\n" }'
+static bool lazy = false;
 
 std::vector<std::string> split(std::string s, std::string delim)
 {
@@ -41,29 +49,10 @@ std::vector<std::string> split(std::string s, std::string delim)
 
 void err(std::string msg)
 {
-	std::cout << msg << std::endl;
+	std::cout << msg << "\n";
 	exit(EXIT_FAILURE);
 }
 
-double toD(std::string s)
-{
-	Parser p;
-	float a;
-	if (!p.parse(s,a))
-		err("parse error");
-	return (double) a;
-}
-
-int toI(std::string s)
-{
-	Parser p;
-	float a;
-	if (!p.parse(s,a))
-		err("parse error");
-	return (int) a;
-}
-
-
 manifold::SimplePolygon loadpoly(std::string filename)
 {
 	manifold::SimplePolygon s;
@@ -102,595 +91,1121 @@ std::vector<std::vector<float>> loadHeightMap(std::string filename)
 }
 
 
-std::string executeParameter(std::string parameter) 
+//Command registry:
+//
+//Each command is a row in commands[] below: its name, help text, an argument spec
+//and a handler of the kind that tells executeCommand() how to apply it to the mesh list.
+//The arguments are split and checked against the spec before the handler runs:
+//
+//  d  number (a plain number or a mathparser expression)
+//  i  integer (as d, truncated)
+//  p  pair of numbers, x|y
+//  s  string
+//  |  the arguments after this are optional
+//  *  any number of further strings (at the end of the spec)
+
+struct Arg {
+	char type;  //the spec character it was parsed by
+	std::string text;
+	double value[2];  //numeric types; only 'p' uses value[1]
+};
+typedef std::vector<Arg> Args;
+
+enum CommandKind {
+	Helper,  //runs on its own, returns an error string
+	Primitive,  //adds a mesh to the list
+	Operator,  //replaces the last mesh, or every mesh with transform:all
+	Aggregator  //replaces the list with one mesh made from all of it
+};
+
+struct Command {
+	const char *group;  //help section
+	const char *name;
+	const char *usage;  //help text following the name
+	const char *spec;
+	CommandKind kind;
+	std::string (*run)(const Args&);
+	manifold::Manifold (*make)(const Args&);
+	manifold::Manifold (*apply)(const manifold::Manifold&, const Args&);
+	manifold::mat3x4 (*matrix)(const Args&);  //transform operators: the affine matrix, applied in place of apply
+	manifold::Manifold (*combine)(const std::vector<manifold::Manifold>&);
+	bool report;  //operators: verbose shows the triangle counts before/after
+	bool reads;  //helpers: uses the meshes themselves, so lazy mode evaluates them first
+	std::string (*check)(const Args&);  //optional: checks beyond the spec, e.g. option names
+};
+
+static Command helper(const char *group, const char *name, const char *usage, const char *spec, std::string (*run)(const Args&), std::string (*check)(const Args&)=nullptr)
 {
-	std::vector<std::string> t = split(parameter, ":");
-	
-	 if (t[0] == "help") {  //cmd --load:filename
-		std::cout << std::endl << "Usage: cadsh [cmd ...]" << std::endl << std::endl << "Commands:" << std::endl;
-		std::cout << " -input/output:" << std::endl;
-		std::cout << "   --load:filename" << std::endl;
-		std::cout << "   --save:filename" << std::endl;
-		std::cout << " -primitives:" << std::endl;
-		std::cout << "   --cube:x,y,z[,'ctr']" << std::endl;
-		std::cout << "   --cylinder:h,rl[,rh[,seg[,'ctr']]]" << std::endl;
-		std::cout << "   --sphere:r[,seg]" << std::endl;
-		std::cout << "   --tetrahedron" << std::endl;
-		std::cout << "   --extrude:polyfilename,height[,div[,twistdeg[,scaletop]]]" << std::endl;
-		std::cout << "   --revolve:polyfilename,segments,degrees" << std::endl;
-		std::cout << " -operators:" << std::endl;
-		std::cout << "   --translate:x,y,z" << std::endl;
-		std::cout << "   --rotate:x,y,z" << std::endl;
-		std::cout << "   --scale:s|x,y,z" << std::endl;
-		std::cout << "   --simplify:s" << std::endl;
-		std::cout << " -aggregators:" << std::endl;
-		std::cout << "   --union" << std::endl;
-		std::cout << "   --subtract" << std::endl;
-		std::cout << "   --intersect" << std::endl;
-		std::cout << "   --hull" << std::endl;
-		std::cout << " -helpers:" << std::endl;
-		std::cout << "   --help" << std::endl;
-		std::cout << "   --status" << std::endl;
-		std::cout << "   --verbose" << std::endl;
-		std::cout << "   --transform:all|last" << std::endl;
-	 }
-
-	//settings
-		
-	else if (t[0] == "verbose") verbose=true;
-		
-	else if (t[0] == "transform") {
-		if (t.size() >= 2) {
-			if (t[1] == "all")
-				all=true;
-			else
-				all=false;
+	return {group, name, usage, spec, Helper, run, nullptr, nullptr, nullptr, nullptr, false, false, check};
+}
+
+static Command reader(const char *group, const char *name, const char *usage, const char *spec, std::string (*run)(const Args&), std::string (*check)(const Args&)=nullptr)
+{
+	return {group, name, usage, spec, Helper, run, nullptr, nullptr, nullptr, nullptr, false, true, check};
+}
+
+static Command primitive(const char *name, const char *usage, const char *spec, manifold::Manifold (*make)(const Args&), std::string (*check)(const Args&)=nullptr)
+{
+	return {"primitives", name, usage, spec, Primitive, nullptr, make, nullptr, nullptr, nullptr, false, false, check};
+}
+
+static Command op(const char *name, const char *usage, const char *spec, manifold::Manifold (*apply)(const manifold::Manifold&, const Args&), bool report=false, std::string (*check)(const Args&)=nullptr)
+{
+	return {"operators (last mesh, or all meshes with transform:all)", name, usage, spec, Operator, nullptr, nullptr, apply, nullptr, nullptr, report, false, check};
+}
+
+static Command affine(const char *name, const char *usage, const char *spec, manifold::mat3x4 (*matrix)(const Args&), std::string (*check)(const Args&)=nullptr)
+{
+	return {"operators (last mesh, or all meshes with transform:all)", name, usage, spec, Operator, nullptr, nullptr, nullptr, matrix, nullptr, false, false, check};
+}
+
+static Command aggregator(const char *name, manifold::Manifold (*combine)(const std::vector<manifold::Manifold>&))
+{
+	return {"aggregators", name, "", "", Aggregator, nullptr, nullptr, nullptr, nullptr, combine, false, false, nullptr};
+}
+
+//evaluates a numeric argument; plain numbers are converted directly,
+//anything else goes through the expression parser.  Only numbers the parser 
+//would take too (a digit first, after the sign) go the direct way, so e.g. 
+//"inf" or ".5" is no more a number bare than inside an expression:
+static bool evaluateNumber(const std::string& s, double& v)
+{
+	float a;
+	const char *b = s.data(), *e = b + s.size();
+	const char *d = b < e && *b == '-' ? b+1 : b;
+	std::from_chars_result r = std::from_chars(b, e, a);
+	if (d < e && isdigit((unsigned char) *d) && r.ec == std::errc() && r.ptr == e) {
+		v = a;
+		return true;
+	}
+	Parser p;
+	if (!p.parse(s, a)) return false;
+	v = a;
+	return true;
+}
+
+//the value of optional argument i, or dflt if it wasn't given:
+static double num(const Args& a, size_t i, double dflt)
+{
+	return i < a.size() ? a[i].value[0] : dflt;
+}
+
+//splits text at the commas and checks and evaluates the pieces against c.spec;
+//returns an error message, empty if a holds the arguments:
+static std::string parseArgs(const Command& c, const std::string& text, Args& a)
+{
+	a.clear();
+	size_t pos = 0;
+	while (text.size() > 0 && pos <= text.size()) {
+		size_t comma = text.find(',', pos);
+		if (comma == std::string::npos) comma = text.size();
+		size_t b = pos, e = comma;  //trimmed, e.g. of the space before a script comment
+		while (b < e && isspace((unsigned char) text[b])) b++;
+		while (e > b && isspace((unsigned char) text[e-1])) e--;
+		a.push_back({'s', text.substr(b, e-b), {0.0, 0.0}});
+		pos = comma + 1;
+	}
+
+	const std::string name = c.name;
+	bool optional = false, rest = false;
+	size_t i = 0;
+	for (const char *s = c.spec; *s; s++) {
+		if (*s == '|') { optional = true; continue; }
+		if (*s == '*') { rest = true; break; }
+		if (i == a.size()) {
+			if (optional) break;
+			return a.empty() ? name+": no parameters" : name+": insufficient parameters";
+		}
+		Arg& g = a[i++];
+		g.type = *s;
+		if (*s == 'd' || *s == 'i') {
+			if (!evaluateNumber(g.text, g.value[0])) return name+": parse error: "+g.text;
+			if (*s == 'i') g.value[0] = (int) g.value[0];
+		}
+		else if (*s == 'p') {
+			size_t bar = g.text.find('|');
+			if (bar == std::string::npos
+				|| !evaluateNumber(g.text.substr(0, bar), g.value[0])
+				|| !evaluateNumber(g.text.substr(bar+1), g.value[1]))
+					return name+": malformed x|y pair: "+g.text;
 		}
-		else return "transform: no parameter";
 	}
-		
-	//cmd -input/output:
-	
-	else if (t[0] == "clear") { 
-		int msize = m.size();
-		if (verbose) {
-			if (msize == 1)
-				std::cout << "clear:" << m.size() << " mesh" << std::endl;
-			else
-				std::cout << "clear:" << m.size() << " meshes" << std::endl;
+	if (i < a.size() && !rest) return name+": too many parameters";
+	if (c.check) return c.check(a);
+	return "";
+}
+
+//the arguments as verbose prints them, expressions evaluated:
+static std::string argText(const Args& a)
+{
+	std::ostringstream o;
+	for (size_t i=0; i<a.size(); i++) {
+		if (i > 0) o << ",";
+		if (a[i].type == 'd' || a[i].type == 'i')
+			o << a[i].value[0];
+		else if (a[i].type == 'p')
+			o << a[i].value[0] << "|" << a[i].value[1];
+		else
+			o << a[i].text;
+	}
+	return o.str();
+}
+
+
+//affine matrices, as columns: the 3x3 linear part, then the translation.
+
+static manifold::mat3x4 identity()
+{
+	return manifold::mat3x4({1,0,0}, {0,1,0}, {0,0,1}, {0,0,0});
+}
+
+static bool isIdentity(const manifold::mat3x4& t)
+{
+	for (int j=0; j<4; j++)
+		for (int i=0; i<3; i++)
+			if (t[j][i] != (i == j ? 1.0 : 0.0)) return false;
+	return true;
+}
+
+//the transform that applies a, then b:
+static manifold::mat3x4 compose(const manifold::mat3x4& b, const manifold::mat3x4& a)
+{
+	manifold::mat3x4 c;
+	for (int j=0; j<4; j++)
+		for (int i=0; i<3; i++)
+			c[j][i] = b[0][i]*a[j][0] + b[1][i]*a[j][1] + b[2][i]*a[j][2] + (j == 3 ? b[3][i] : 0.0);
+	return c;
+}
+
+
+//Lazy mode:
+//
+//Primitives, operators and aggregators only record themselves: each entry of the
+//mesh list is the expression tree of the commands that make it, and nothing is 
+//built until a command that reads the meshes (save, info) needs them.  Meshes 
+//cleared before that are never built, nested unions and intersections (and 
+//subtractions of unions) collapse into one BatchBoolean, and independent 
+//subtrees are built in parallel.  Consecutive transforms of an unbuilt mesh
+//multiply into one matrix.  Loads are still read when they're run.
+
+struct Node {
+	const Command *command;  //nullptr once the mesh is made
+	Args args;
+	std::vector<std::unique_ptr<Node>> operands;  //an operator's mesh, or an aggregator's list
+	manifold::mat3x4 matrix;  //transform operators: the product of the consecutive ones
+	manifold::Manifold mesh;
+	size_t level;  //while building: 0 for a node of built operands, else one above its highest operand
+
+	//frees the tree below without recursing once per level, so a long chain can't overflow the stack:
+	~Node()
+	{
+		std::vector<std::unique_ptr<Node>> doomed = std::move(operands);
+		while (!doomed.empty()) {
+			std::unique_ptr<Node> n = std::move(doomed.back());
+			doomed.pop_back();
+			for (auto &o : n->operands) doomed.push_back(std::move(o));
+			n->operands.clear();
 		}
-		m.clear();
 	}
-		
-	else if (t[0] == "load") {  //cmd --load:filename
-		if (t.size() >= 2) {
-			std::filesystem::path p = std::string(t[1]);
-			if (p.extension() == ".3mf") {
-				std::vector<manifold::Manifold> mm = ImportMeshes3MF(t[1]);
-				int count = 0;
-				for (auto msh : mm) {
-					m.push_back(msh);
-					count++;
-				}
-				if (verbose) std::cout << "load:" << t[1] << ", " << count << " meshes" << std::endl;
-			}
-			else if (p.extension() == ".stl") {
-				manifold::MeshGL msh = ImportMeshSTL(t[1]);
-				if (msh.Merge()) 
-					if (verbose) 
-						std::cout << "load: STL file fixed" << std::endl;
-				manifold::Manifold mm(msh);
-				if (mm.Status() != manifold::Manifold::Error::NoError)
-					return "load: STL too borked to make a Manifold";
-				m.push_back(mm);
-				if (verbose) std::cout << "load:" << t[1] << ", " << m.size() << " meshes" << std::endl;
+};
+
+static std::vector<std::unique_ptr<Node>> dag;
+
+static std::unique_ptr<Node> leaf(const manifold::Manifold& mesh)
+{
+	std::unique_ptr<Node> n(new Node);
+	n->command = nullptr;
+	n->mesh = mesh;
+	return n;
+}
+
+static std::unique_ptr<Node> defer(const Command& c, const Args& a, std::vector<std::unique_ptr<Node>> operands)
+{
+	std::unique_ptr<Node> n(new Node);
+	n->command = &c;
+	n->args = a;
+	n->operands = std::move(operands);
+	if (c.matrix) n->matrix = c.matrix(a);
+	return n;
+}
+
+static bool isAggregate(const Node& n, const char *name)
+{
+	return n.command && strcmp(n.command->name, name) == 0;
+}
+
+//splices the operands of nested booleans that mean the same as their parts, 
+//(a+b)+c = a+b+c, (a-b)-c = a-b-c, a-(b+c) = a-b-c:
+static void flatten(const Command& c, std::vector<std::unique_ptr<Node>>& operands)
+{
+	std::vector<std::unique_ptr<Node>> f;
+	bool subtract = strcmp(c.name, "subtract") == 0;
+	if (!subtract && strcmp(c.name, "union") != 0 && strcmp(c.name, "intersect") != 0) return;
+	for (size_t i=0; i<operands.size(); i++) {
+		Node& n = *operands[i];
+		bool splice = subtract ? (i == 0 ? isAggregate(n, "subtract") : isAggregate(n, "union")) : isAggregate(n, c.name);
+		if (splice) 
+			for (auto &o : n.operands) f.push_back(std::move(o));
+		else
+			f.push_back(std::move(operands[i]));
+	}
+	operands = std::move(f);
+}
+
+//builds the trees' meshes, and frees the trees below them.  A walk with an explicit
+//stack (chains of commands can be any length) sorts the unbuilt nodes into levels, 
+//each level's nodes needing only meshes from the levels before; a level's nodes 
+//are independent of each other, so they're built in parallel.
+static void buildNodes(std::vector<std::unique_ptr<Node>>& roots)
+{
+	std::vector<std::vector<Node *>> levels;
+	std::vector<std::pair<Node *, size_t>> stack;  //node, next operand to visit
+	for (auto &root : roots) {
+		if (root->command) stack.push_back({root.get(), 0});
+		while (!stack.empty()) {
+			Node *n = stack.back().first;
+			size_t& next = stack.back().second;
+			if (next < n->operands.size()) {
+				Node *o = n->operands[next++].get();
+				if (o->command) stack.push_back({o, 0});
+				continue;
 			}
-			else
-				std::cout << "invalid filename: " << t[1] << std::endl;
+			n->level = 0;
+			for (auto &o : n->operands)
+				if (o->command) n->level = std::max(n->level, o->level + 1);
+			if (levels.size() <= n->level) levels.resize(n->level + 1);
+			levels[n->level].push_back(n);
+			stack.pop_back();
 		}
-		else return "load: no parameters";
-	}
-		
-	else if (t[0] == "save") {  //cmd --save:filename
-		if (t.size() >= 2) {
-			std::filesystem::path p = std::string(t[1]);
-			if (p.extension() == ".3mf") {
-				if (verbose) std::cout << "save:" << t[1] << std::endl;
-				ExportMeshes3MF(t[1], m);
-				
+	}
+
+	for (auto &level : levels) {
+		parallelFor(level.size(), [&](size_t i) {
+			Node& n = *level[i];
+			if (n.command->kind == Primitive)
+				n.mesh = n.command->make(n.args);
+			else if (n.command->matrix)
+				n.mesh = n.operands[0]->mesh.Transform(n.matrix);
+			else if (n.command->kind == Operator)
+				n.mesh = n.command->apply(n.operands[0]->mesh, n.args);
+			else {
+				std::vector<manifold::Manifold> in;
+				for (auto &o : n.operands) in.push_back(o->mesh);
+				n.mesh = n.command->combine(in);
 			}
-			else
-				std::cout << "invalid filename: " << t[1] << std::endl;
-		}
-		else return "save: no parameters";
+			n.command = nullptr;
+			n.operands.clear();
+		});
 	}
-	
-	else if (t[0] == "status") {
-		if (m.size() == 1)
-			std::cout << m.size() << " mesh" << std::endl;
+}
+
+//builds the lazy list into m:
+static void evaluateAll()
+{
+	if (verbose) std::cout << "evaluate: " << dag.size() << (dag.size() == 1 ? " mesh\n" : " meshes\n");
+	buildNodes(dag);
+	for (auto &n : dag) m.push_back(n->mesh);
+	dag.clear();
+}
+
+
+//helpers:
+
+static std::string help(const Args&);
+
+static std::string verboseOn(const Args&)
+{
+	verbose = true;
+	return "";
+}
+
+static std::string checkTransform(const Args& a)
+{
+	if (a[0].text != "all" && a[0].text != "last") return "transform: all or last: "+a[0].text;
+	return "";
+}
+
+static std::string transform(const Args& a)
+{
+	all = a[0].text == "all";
+	return "";
+}
+
+static std::string status(const Args&)
+{
+	size_t n = m.size() + dag.size();
+	if (n == 1)
+		std::cout << n << " mesh\n";
+	else
+		std::cout << n << " meshes\n";
+	return "";
+}
+
+static std::string checkThreads(const Args& a)
+{
+	if (a[0].value[0] < 0) return "threads: must be 0 (one per hardware thread) or more";
+	return "";
+}
+
+static std::string threads(const Args& a)
+{
+	threadLimit() = (unsigned) a[0].value[0];
+	return "";
+}
+
+static std::string checkLazy(const Args& a)
+{
+	if (a.size() >= 1 && a[0].text != "on" && a[0].text != "off") return "lazy: on or off: "+a[0].text;
+	return "";
+}
+
+static std::string lazyMode(const Args& a)
+{
+	lazy = a.empty() || a[0].text == "on";
+	if (lazy) {
+		for (auto &mm : m) dag.push_back(leaf(mm));
+		m.clear();
+	}
+	else if (!dag.empty()) 
+		evaluateAll();
+	return "";
+}
+
+static std::string info(const Args&)
+{
+	for (unsigned i=0; i<m.size(); i++)
+		std::cout << i << ":"
+			<< " NumVert:" << m[i].NumVert()
+			<< " NumEdge:" << m[i].NumEdge()
+			<< " NumTri:" << m[i].NumTri()
+			<< " NumProp:" << m[i].NumProp()
+			<< " NumPropVert:" << m[i].NumPropVert()
+			<< " Genus:" << m[i].Genus()
+			<< " Tolerance:" << m[i].GetTolerance()
+			<< " Status:" << manifoldError(m[i].Status())
+			<< "\n";
+	return "";
+}
+
+
+//input/output:
+
+static std::string clear(const Args&)
+{
+	size_t n = m.size() + dag.size();
+	if (verbose) {
+		if (n == 1)
+			std::cout << "clear:" << n << " mesh\n";
 		else
-			std::cout << m.size() << " meshes" << std::endl;
-	}
-		
-	else if (t[0] == "info") {
-		for (unsigned i=0; i<m.size(); i++)
-			std::cout << i << ":" 
-				<< " NumVert:" << m[i].NumVert() 
-				<< " NumEdge:" << m[i].NumEdge()
-				<< " NumTri:" << m[i].NumTri()
-				<< " NumProp:" << m[i].NumProp()
-				<< " NumPropVert:" << m[i].NumPropVert()
-				<< " Genus:" << m[i].Genus()
-				<< " Tolerance:" << m[i].GetTolerance()
-				<< " Status:" << manifoldError(m[i].Status()) 
-				<< std::endl;
-	}
-		
-	else if (t[0] == "calculatenormals") {
-			
-		if (all) {
-			if (verbose) std::cout << "calculatenormals, " << m.size() << " meshes" << std::endl;
-			for (auto &mm : m)
-				mm = mm.CalculateNormals(0); 
-		}
-		else {
-			if (verbose) std::cout << "calculatenormals, last mesh" << std::endl;
-			m[m.size()-1] = m[m.size()-1].CalculateNormals(0);
+			std::cout << "clear:" << n << " meshes\n";
+	}
+	m.clear();
+	dag.clear();
+	return "";
+}
+
+//the options following load's filename:
+static std::string loadOptions(const Args& a, ImportSTLOptions& opt)
+{
+	//weld, normals and stream are all STL import options:
+	bool stl = std::filesystem::path(a[0].text).extension() == ".stl";
+	for (unsigned i=1; i<a.size(); i++) {
+		const std::string& o = a[i].text;
+		size_t eq = o.find('=');
+		if (!stl && (o.compare(0, eq, "weld") == 0 || o == "normals" || o == "stream"))
+			return "load: "+o.substr(0, eq)+" applies only to .stl files";
+		if (o.compare(0, eq, "weld") == 0 && eq != std::string::npos) {
+			double w = 0.0;
+			if (o.substr(eq+1) != "exact" && !evaluateNumber(o.substr(eq+1), w)) return "load: parse error: "+o;
+			if (!(w >= 0)) return "load: weld must be exact or >= 0";
+			opt.weld = w;
 		}
+		else if (o == "normals")
+			opt.normals = true;
+		else if (o == "stream")
+			opt.stream = true;
+		else return "load: invalid option: "+o;
 	}
-		
-		
-	//cmd -primitives:
-		
-	else if (t[0] == "cube") {  //cmd --cube:x,y,z[,'ctr']
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			double x, y, z;
-			bool ctr;
-			if (p.size() >= 3) {
-				x =toD(p[0]); y = toD(p[1]); z = toD(p[2]);
-			}
-			else return "cube: insufficient parameters";
-			if (p.size() >=4) {
-				if (p[3] == "ctr")
-					ctr = true;
-			}
-			
-			m.push_back(manifold::Manifold::Cube({x,y,z}, ctr));
-			if (verbose) std::cout << "cube: " << x << "," << y << "," << z << " " << std::endl;
-			//if (verbose) std::cout << "cube: " << x << "," << y << "," << z << " " << manifoldError(m[m.size()-1].Status())  << td::endl;
+	return "";
+}
+
+static std::string checkLoad(const Args& a)
+{
+	ImportSTLOptions opt;
+	return loadOptions(a, opt);
+}
+
+static std::string load(const Args& a)
+{
+	std::string filename = a[0].text;
+	ImportSTLOptions opt;
+	std::string e = loadOptions(a, opt);
+	if (!e.empty()) return e;
+	std::filesystem::path p = filename;
+	if (p.extension() == ".3mf") {
+		std::vector<manifold::Manifold> mm = ImportMeshes3MF(filename);
+		int count = 0;
+		for (auto msh : mm) {
+			m.push_back(msh);
+			count++;
 		}
-		else return "cube: no parameters";
-	}
-		
-	else if (t[0] == "cylinder") {  //cmd --cylinder:h,rl[,rh[,seg[,'ctr']]]
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			double h, rl, rh=-1.0;
-			int seg=0;
-			bool ctr=false;
-				
-			if (p.size() >= 2) {
-				h = toD(p[0]); rl = toD(p[1]);
-			}
-			else return "cylinder: need at least h and rl";
-			if (p.size() >= 3) {
-				rh = toD(p[2]);
-			}
-			if (p.size() >= 4) {
-				seg = toI(p[3]);
-			}
-			if (p.size() >= 5) {
-				if (p[4] == "center")
-					ctr = true;
-			}
-			m.push_back(manifold::Manifold::Cylinder(h, rl, rh, seg, ctr));
-			if (verbose) std::cout << "cylinder: " << h << "," << rl << "," << rh << std::endl;
-			//if (verbose) std::cout << "cylinder: " << h << "," << rl << "," << rh << " " << manifoldError(m[m.size()-1].Status()) << std::endl;
+		if (verbose) std::cout << "load:" << filename << ", " << count << " meshes\n";
+	}
+	else if (p.extension() == ".cmesh") {
+		std::vector<manifold::Manifold> mm;
+		try {
+			mm = ImportMeshesCMesh(filename);
 		}
-		else return "cylinder: no parameters";
-	}
-		
-	else if (t[0] == "sphere") {  //cmd --sphere:r[,seg]
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			double r;
-			int seg=0;
-			if (p.size() >= 1) {
-				r = toD(p[0]);
-			}
-			else return "sphere: needs at least r";
-			if (p.size() >= 2) {
-				seg = toI(p[1]);
-			}
-			m.push_back(manifold::Manifold::Sphere(r, seg));
-			if (verbose) std::cout << "sphere: " << r << " " << manifoldError(m[m.size()-1].Status()) << std::endl;
+		catch (std::exception& e) {
+			return std::string("load: ")+e.what();
 		}
-		else return "sphere: no parameters";
-	}
-
-	else if (t[0] == "icosahedron") {  //cmd --tetrahedron
-		manifold::MeshGL mesh = icosahedron();
-		//std::cout << "numPts: " << mesh.NumVert() << "  numTris: " << mesh.NumTri() << std::endl;
-		m.push_back(manifold::Manifold(mesh));
-		if (verbose) std::cout << "icosahedron: "<< manifoldError(m[m.size()-1].Status()) << std::endl;
-	}
-		
-	else if (t[0] == "tetrahedron") {  //cmd --tetrahedron
-		m.push_back(manifold::Manifold::Tetrahedron());
-		if (verbose) std::cout << "tetrahedron: "<< manifoldError(m[m.size()-1].Status()) << std::endl;
-	}
-		
-	else if (t[0] == "extrude") {  //cmd --extrude:polyfilename,height[,div[,twistdeg[,scaletop]]]
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			manifold::Polygons pg;
-			double h;
-			int d=0;
-			double t=0.0;
-			manifold::vec2 s = {1,1};
-		
-			if (p.size() >= 2) {
-				pg.push_back(loadpoly(p[0]));
-				h = toD(p[1]);
-			}
-			else return "extrude: needs at least polygon and h";
-			if (p.size() >= 3) {
-				d = toI(p[2]);
-			}
-			if (p.size() >= 4) {
-				t = toI(p[3]);
-			}
-			if (p.size() >= 5) {
-				std::vector<std::string> ss = split(p[4], "|");
-				if (ss.size() >= 2) {
-					s[0] = toD(ss[0]);
-					s[0] = toD(ss[1]);
-				}
-				else return "extrude: malformed scale";
-			}
-			
-			m.push_back(manifold::Manifold::Extrude(pg, h, d, t, s));
-			if (verbose) std::cout << "extrude: "<< manifoldError(m[m.size()-1].Status()) << std::endl;
-				
+		for (auto &msh : mm) {
+			if (msh.Status() != manifold::Manifold::Error::NoError)
+				return "load: cmesh mesh invalid: " + manifoldError(msh.Status());
+			m.push_back(msh);
 		}
-		else return "extrude: no parameters";
-	}
-		
-	else if (t[0] == "revolve") {  //cmd --revolve:polyfilename,segments,degrees
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			manifold::Polygons pg;
-			int seg=0;
-			double d =360.0;
-	
-			if (p.size() >= 1) {
-				pg.push_back(loadpoly(p[0]));
-			}
-			else return "revolve: needs at least polygon";
-			if (p.size() >= 2) {
-				seg = toI(p[1]);
-			}
-			if (p.size() >= 3) {
-				d = toI(p[2]);
-			}
-			
-			m.push_back(manifold::Manifold::Revolve(pg, seg, d));
-			if (verbose) std::cout << "revolve: "<< manifoldError(m[m.size()-1].Status()) << std::endl;
-				
+		if (verbose) std::cout << "load:" << filename << ", " << mm.size() << " meshes\n";
+	}
+	else if (p.extension() == ".stl" || p.extension() == ".obj" || p.extension() == ".ply") {
+		std::string format = p.extension() == ".stl" ? "STL" : p.extension() == ".obj" ? "OBJ" : "PLY";
+		std::vector<manifold::MeshGL> mg;
+		try {
+			if (format == "STL")
+				mg.push_back(ImportMeshSTL(filename, opt));
+			else if (format == "OBJ")
+				mg = ImportMeshesOBJ(filename);
+			else
+				mg.push_back(ImportMeshPLY(filename));
 		}
-		else return "revolve: no parameters";
-	}
-		
-	else if (t[0] == "heightmap") {  //cmd --heightmap:heightmapfile[height[contour]]
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			std::string filename;
-			float height = -1.0;
-			bool contour = false;
-			if (p.size() >= 1) {
-				filename = p[0];
-			}
-			else return "heightmap: needs at least a heightmap file";
-			if (p.size() >= 2) {
-				height = toD(p[1]);
-			}
-			if (p.size() >= 3) {
-				if (p[2] == "true")
-					contour = true;
-				else if (p[2] == "false")
-					contour = false;
-				else return "heightmap: contour paramter not valid: "+p[2];
-			}
-			
-			std::vector<std::vector<float>> hm = loadHeightMap(filename);
-			manifold::MeshGL mesh =  heightmap2mesh(hm, height, contour);
-			//ExportMeshGL3MF("test.3mf", mesh);
-			m.push_back(manifold::Manifold(mesh));
-			if (verbose) std::cout << "heightmap: "<< manifoldError(m[m.size()-1].Status()) << std::endl;
+		catch (std::exception& e) {
+			return std::string("load: ")+e.what();
 		}
-		else return "heightmap: no parameters";
-	}
-		
-		
-	//cmd -operators (work on only last mesh):
-		
-	else if (t[0] == "translate") {  //cmd --translate:x,y,z
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			if (p.size() == 3) {
-				double x =toD(p[0]); double y = toD(p[1]); double z = toD(p[2]);
-				if (all) {
-					if (verbose) std::cout << "translate(all): " << x << "," << y << "," << z << std::endl;
-					for (auto &mm : m)
-						mm = mm.Translate({x,y,z}); 
-				}
-				else {
-					if (verbose) std::cout << "translate(last): " << x << "," << y << "," << z << std::endl;
-					m[m.size()-1] = m[m.size()-1].Translate({x,y,z}); 
-				}
-				
+		int count = 0;
+		for (auto &msh : mg) {
+			//the weld (or the file's own indexing) usually makes it manifold already;
+			//MeshGL::Merge() (a topology-aware weld of the open edges) is only the repair path:
+			manifold::Manifold mm(msh);
+			if (mm.Status() == manifold::Manifold::Error::NotManifold && msh.Merge()) {
+				if (verbose)
+					std::cout << "load: " << format << " file fixed\n";
+				mm = manifold::Manifold(msh);
 			}
-			else return "translate: invalid parameters";
+			if (mm.Status() != manifold::Manifold::Error::NoError)
+				return "load: " + format + " too borked to make a Manifold";
+			m.push_back(mm);
+			count++;
 		}
+		if (verbose) std::cout << "load:" << filename << ", " << count << " meshes\n";
 	}
-		
-	else if (t[0] == "rotate") {  //cmd --rotate:x,y,z
-		if (t.size() >= 2) {
-			std::vector<std::string> p = split(t[1], ",");
-			if (p.size() == 3) {
-				double x =toD(p[0]); double y = toD(p[1]); double z = toD(p[2]);
-				if (all) {
-					if (verbose) std::cout << "rotate(all): " << x << "," << y << "," << z << std::endl;
-					for (auto &mm : m)
-						mm = mm.Rotate(x,y,z); 
-				}
-				else {
-					if (verbose) std::cout << "rotate(last): " << x << "," << y << "," << z << std::endl;
-					m[m.size()-1] = m[m.size()-1].Rotate(x,y,z);
-				}
-			}
-			else return "rotate: invalid parameters";
+	else
+		std::cout << "invalid filename: " << filename << "\n";
+	return "";
+}
+
+//the options following save's filename:
+static std::string saveOptions(const Args& a, Export3MFOptions& opt, bool& ascii)
+{
+	//level, store and parallel are 3MF options, ascii a PLY one, and precision is for the text formats:
+	std::string ext = std::filesystem::path(a[0].text).extension().string();
+	std::string precision;
+	for (unsigned i=1; i<a.size(); i++) {
+		const std::string& o = a[i].text;
+		size_t eq = o.find('=');
+		if (ext != ".3mf" && (o.compare(0, eq, "level") == 0 || o == "store" || o == "parallel"))
+			return "save: "+o.substr(0, eq)+" applies only to .3mf files";
+		if (ext != ".ply" && o == "ascii")
+			return "save: ascii applies only to .ply files";
+		double v = 0.0;
+		if (eq != std::string::npos && !evaluateNumber(o.substr(eq+1), v)) return "save: parse error: "+o;
+		if (o.compare(0, eq, "precision") == 0 && eq != std::string::npos) {
+			precision = o;
+			opt.precision = (int) v;
+			if (opt.precision < -1 || opt.precision > 20) return "save: precision must be -1 to 20";
 		}
+		else if (o.compare(0, eq, "level") == 0 && eq != std::string::npos) {
+			opt.level = (int) v;
+			if (opt.level < 0 || opt.level > 10) return "save: level must be 0 to 10";
+		}
+		else if (o == "store")
+			opt.level = 0;
+		else if (o == "parallel")
+			opt.parallel = true;
+		else if (o == "ascii")
+			ascii = true;
+		else return "save: invalid option: "+o;
 	}
-		
-	else if (t[0] == "scale") { //cmd --scale:s|x,y,z
-		manifold::vec3 s;
-		if (t.size() >= 2) {
-				
-			std::vector<std::string> p = split(t[1], ",");
-			if (p.size() == 1) {
-				s[0] = s[1] =s[2] = toD(t[1]);
-			}
-			else if (p.size() == 3) {
-				s.x =toD(p[0]); s.y = toD(p[1]); s.z = toD(p[2]);
-			}
-			else {
-				return "scale: malformed parameters";
+	if (!precision.empty() && ext != ".3mf" && ext != ".obj" && !(ext == ".ply" && ascii))
+		return "save: precision applies only to .3mf, .obj and ascii .ply files";
+	return "";
+}
+
+static std::string checkSave(const Args& a)
+{
+	Export3MFOptions opt;
+	bool ascii = false;
+	return saveOptions(a, opt, ascii);
+}
+
+static std::string save(const Args& a)
+{
+	std::string filename = a[0].text;
+	Export3MFOptions opt;
+	bool ascii = false;
+	std::string e = saveOptions(a, opt, ascii);
+	if (!e.empty()) return e;
+	std::filesystem::path p = filename;
+	bool written;
+	if (p.extension() == ".3mf")
+		written = ExportMeshes3MF(filename, m, opt);
+	else if (p.extension() == ".stl")
+		written = ExportMeshesSTL(filename, m);
+	else if (p.extension() == ".cmesh")
+		written = ExportMeshesCMesh(filename, m);
+	else if (p.extension() == ".obj")
+		written = ExportMeshesOBJ(filename, m, opt.precision);
+	else if (p.extension() == ".ply")
+		written = ExportMeshesPLY(filename, m, ascii, opt.precision);
+	else {
+		std::cout << "invalid filename: " << filename << "\n";
+		return "";
+	}
+	if (verbose) std::cout << "save:" << filename << "\n";
+	if (!written) return "save: write failed: "+filename;
+	return "";
+}
+
+
+//primitives:
+
+static manifold::Manifold cube(const Args& a)
+{
+	bool ctr = a.size() >= 4 && a[3].text == "ctr";
+	return manifold::Manifold::Cube({a[0].value[0], a[1].value[0], a[2].value[0]}, ctr);
+}
+
+static manifold::Manifold cylinder(const Args& a)
+{
+	bool ctr = a.size() >= 5 && (a[4].text == "ctr" || a[4].text == "center");
+	return manifold::Manifold::Cylinder(a[0].value[0], a[1].value[0], num(a, 2, -1.0), (int) num(a, 3, 0), ctr);
+}
+
+static manifold::Manifold sphere(const Args& a)
+{
+	return manifold::Manifold::Sphere(a[0].value[0], (int) num(a, 1, 0));
+}
+
+static manifold::Manifold icosahedronMesh(const Args&)
+{
+	return manifold::Manifold(icosahedron());
+}
+
+static manifold::Manifold tetrahedron(const Args&)
+{
+	return manifold::Manifold::Tetrahedron();
+}
+
+static manifold::Manifold extrude(const Args& a)
+{
+	manifold::Polygons pg;
+	pg.push_back(loadpoly(a[0].text));
+	manifold::vec2 s = {1,1};
+	if (a.size() >= 5) s = {a[4].value[0], a[4].value[1]};
+	return manifold::Manifold::Extrude(pg, a[1].value[0], (int) num(a, 2, 0), num(a, 3, 0.0), s);
+}
+
+static manifold::Manifold revolve(const Args& a)
+{
+	manifold::Polygons pg;
+	pg.push_back(loadpoly(a[0].text));
+	return manifold::Manifold::Revolve(pg, (int) num(a, 1, 0), num(a, 2, 360.0));
+}
+
+static std::string checkHeightmap(const Args& a)
+{
+	if (a.size() >= 3 && a[2].text != "true" && a[2].text != "false")
+		return "heightmap: contour paramter not valid: "+a[2].text;
+	return "";
+}
+
+static manifold::Manifold heightmap(const Args& a)
+{
+	std::vector<std::vector<float>> hm = loadHeightMap(a[0].text);
+	return manifold::Manifold(heightmap2mesh(hm, num(a, 1, -1.0), a.size() >= 3 && a[2].text == "true"));
+}
+
+
+//operators:
+
+static manifold::mat3x4 translate(const Args& a)
+{
+	return manifold::mat3x4({1,0,0}, {0,1,0}, {0,0,1}, {a[0].value[0], a[1].value[0], a[2].value[0]});
+}
+
+//sine of an angle in degrees, exact at multiples of 90 as in Manifold::Rotate():
+static double sinDegrees(double x)
+{
+	if (!std::isfinite(x)) return std::sin(x);
+	if (x < 0.0) return -sinDegrees(-x);
+	int quo;
+	x = std::remquo(std::fabs(x), 90.0, &quo);
+	const double pi = 3.14159265358979323846;
+	const double r = x * pi / 180.0;
+	switch (quo % 4) {
+		case 0: return std::sin(r);
+		case 1: return std::cos(r);
+		case 2: return -std::sin(r);
+		default: return -std::cos(r);
+	}
+}
+
+static double cosDegrees(double x)
+{
+	return sinDegrees(x + 90.0);
+}
+
+//about x, then y, then z, the same as Manifold::Rotate():
+static manifold::mat3x4 rotate(const Args& a)
+{
+	double x = a[0].value[0], y = a[1].value[0], z = a[2].value[0];
+	manifold::mat3x4 rx({1,0,0}, {0, cosDegrees(x), sinDegrees(x)}, {0, -sinDegrees(x), cosDegrees(x)}, {0,0,0});
+	manifold::mat3x4 ry({cosDegrees(y), 0, -sinDegrees(y)}, {0,1,0}, {sinDegrees(y), 0, cosDegrees(y)}, {0,0,0});
+	manifold::mat3x4 rz({cosDegrees(z), sinDegrees(z), 0}, {-sinDegrees(z), cosDegrees(z), 0}, {0,0,1}, {0,0,0});
+	return compose(rz, compose(ry, rx));
+}
+
+static std::string checkScale(const Args& a)
+{
+	if (a.size() == 2) return "scale: malformed parameters";
+	return "";
+}
+
+static manifold::mat3x4 scale(const Args& a)
+{
+	double x = a[0].value[0], y = a.size() == 1 ? x : a[1].value[0], z = a.size() == 1 ? x : a[2].value[0];
+	return manifold::mat3x4({x,0,0}, {0,y,0}, {0,0,z}, {0,0,0});
+}
+
+//the twelve numbers are the matrix's three rows, translation last in each:
+static manifold::mat3x4 matrix(const Args& a)
+{
+	manifold::mat3x4 t;
+	for (int i=0; i<3; i++)
+		for (int j=0; j<4; j++)
+			t[j][i] = a[i*4+j].value[0];
+	return t;
+}
+
+static manifold::Manifold simplify(const manifold::Manifold& mm, const Args& a)
+{
+	return mm.Simplify(a[0].value[0]);
+}
+
+static manifold::Manifold refine(const manifold::Manifold& mm, const Args& a)
+{
+	return mm.Refine((int) a[0].value[0]);
+}
+
+static manifold::Manifold refineToLength(const manifold::Manifold& mm, const Args& a)
+{
+	return mm.RefineToLength(a[0].value[0]);
+}
+
+static manifold::Manifold refineToTolerance(const manifold::Manifold& mm, const Args& a)
+{
+	return mm.RefineToTolerance(a[0].value[0]);
+}
+
+static manifold::Manifold smoothOut(const manifold::Manifold& mm, const Args& a)
+{
+	return mm.SmoothOut(num(a, 0, 60.0), num(a, 1, 0.0));
+}
+
+static manifold::Manifold smoothByNormals(const manifold::Manifold& mm, const Args&)
+{
+	return mm.SmoothByNormals(0);
+}
+
+static manifold::Manifold calculateNormals(const manifold::Manifold& mm, const Args&)
+{
+	return mm.CalculateNormals(0);
+}
+
+
+//aggregators:
+
+static manifold::Manifold unionAll(const std::vector<manifold::Manifold>& mm)
+{
+	return manifold::Manifold::BatchBoolean(mm, manifold::OpType::Add);
+}
+
+static manifold::Manifold subtractAll(const std::vector<manifold::Manifold>& mm)
+{
+	return manifold::Manifold::BatchBoolean(mm, manifold::OpType::Subtract);
+}
+
+static manifold::Manifold intersectAll(const std::vector<manifold::Manifold>& mm)
+{
+	return manifold::Manifold::BatchBoolean(mm, manifold::OpType::Intersect);
+}
+
+static manifold::Manifold hull(const std::vector<manifold::Manifold>& mm)
+{
+	return manifold::Manifold::Hull(mm);
+}
+
+
+static const Command commands[] = {
+	helper("input/output", "load", ":filename[,weld=eps|exact][,normals][,stream]", "s*", load, checkLoad),
+	reader("input/output", "save", ":filename[,precision=n][,level=n|store][,parallel][,ascii]", "s*", save, checkSave),
+	helper("input/output", "clear", "", "", clear),
+
+	primitive("cube", ":x,y,z[,'ctr']", "ddd|s", cube),
+	primitive("cylinder", ":h,rl[,rh[,seg[,'ctr']]]", "dd|dis", cylinder),
+	primitive("sphere", ":r[,seg]", "d|i", sphere),
+	primitive("tetrahedron", "", "", tetrahedron),
+	primitive("icosahedron", "", "", icosahedronMesh),
+	primitive("extrude", ":polyfilename,height[,div[,twistdeg[,scalex|scaley]]]", "sd|idp", extrude),
+	primitive("revolve", ":polyfilename[,segments[,degrees]]", "s|id", revolve),
+	primitive("heightmap", ":heightmapfile[,height[,true|false]]", "s|ds", heightmap, checkHeightmap),
+
+	affine("translate", ":x,y,z", "ddd", translate),
+	affine("rotate", ":x,y,z", "ddd", rotate),
+	affine("scale", ":s|x,y,z", "d|dd", scale, checkScale),
+	op("simplify", ":s", "d", simplify, true),
+	op("refine", ":n", "i", refine, true),
+	op("refinetolength", ":l", "d", refineToLength, true),
+	op("refinetotolerance", ":t", "d", refineToTolerance, true),
+	op("smoothout", "[:msa[,ms]]", "|dd", smoothOut, true),
+	op("smoothbynormals", "", "", smoothByNormals, true),
+	op("calculatenormals", "", "", calculateNormals),
+
+	aggregator("union", unionAll),
+	aggregator("subtract", subtractAll),
+	aggregator("intersect", intersectAll),
+	aggregator("hull", hull),
+
+	helper("helpers", "help", "", "", help),
+	helper("helpers", "status", "", "", status),
+	reader("helpers", "info", "", "", info),
+	helper("helpers", "verbose", "", "", verboseOn),
+	helper("helpers", "lazy", "[:on|off]", "|s", lazyMode, checkLazy),
+	helper("helpers", "threads", ":n", "i", threads, checkThreads),
+
+	//one name, told apart by the number of arguments:
+	helper("helpers", "transform", ":all|last", "s", transform, checkTransform),
+	affine("transform", ":xx,xy,xz,x,yx,yy,yz,y,zx,zy,zz,z", "dddddddddddd", matrix)
+};
+
+static const size_t commandCount = sizeof(commands) / sizeof(commands[0]);
+
+//name -> command, through a perfect hash: the seed is searched once at startup until
+//no two names share a slot, so a lookup is one hash and one string compare.
+class CommandTable
+{
+public:
+	CommandTable()
+	{
+		static_assert(sizeof(commands) / sizeof(commands[0]) < slots / 2, "CommandTable: grow slots");
+		for (seed=1; ; seed++) {
+			std::fill(slot, slot+slots, -1);
+			size_t i;
+			for (i=0; i<commandCount; i++) {
+				if (i > 0 && strcmp(commands[i].name, commands[i-1].name) == 0) continue;  //an overload
+				unsigned h = hash(commands[i].name, strlen(commands[i].name));
+				if (slot[h] != -1) break;
+				slot[h] = (int) i;
 			}
+			if (i == commandCount) break;
 		}
-		else return "scale: no parameters";
-			
-		if (all) {
-			if (verbose) std::cout << "scale (all): " << s.x << "," << s.y << "," << s.z << std::endl;
-			for (auto &mm : m)
-				mm = mm.Scale(s); 
-		}
-		else {
-			if (verbose) std::cout << "scale (last): " << s.x << "," << s.y << "," << s.z << std::endl;
-			m[m.size()-1] = m[m.size()-1].Scale(s);
+	}
+
+	const Command *find(const char *name, size_t len) const
+	{
+		int i = slot[hash(name, len)];
+		if (i == -1 || strncmp(commands[i].name, name, len) != 0 || commands[i].name[len] != '\0')
+			return nullptr;
+		return &commands[i];
+	}
+
+private:
+	static const unsigned slots = 128;
+
+	//FNV-1a, started from the seed:
+	unsigned hash(const char *s, size_t len) const
+	{
+		uint32_t h = 2166136261u ^ seed;
+		for (size_t i=0; i<len; i++) {
+			h ^= (unsigned char) s[i];
+			h *= 16777619u;
 		}
-			
-	}
-		
-	else if (t[0] == "simplify") { //cmd --simplify:s
-		if (t.size() == 2) {
-			double s = toD(t[1]);
-			if (all) {
-				if (verbose) std::cout << "simplify(all): " << s << "..." << std::endl;
-				for (auto &mm : m) {
-					int before = mm.NumTri();
-					mm = mm.Simplify(s);
-					int after = mm.NumTri();
-					if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+		return (h ^ (h >> 16)) & (slots-1);
+	}
+
+	uint32_t seed;
+	int slot[slots];
+};
+
+static const CommandTable commandTable;
+
+static std::string help(const Args&)
+{
+	std::cout << "\nUsage: cadsh [cmd ...]\n\nCommands:\n";
+	for (size_t g=0; g<commandCount; g++) {
+		const char *group = commands[g].group;
+		bool first = true;
+		for (size_t i=0; i<g; i++)
+			if (strcmp(commands[i].group, group) == 0) first = false;
+		if (!first) continue;
+		std::cout << " -" << group << ":\n";
+		for (size_t i=g; i<commandCount; i++)
+			if (strcmp(commands[i].group, group) == 0)
+				std::cout << "   --" << commands[i].name << commands[i].usage << "\n";
+	}
+	return "";
+}
+
+//records a primitive, operator or aggregator in lazy mode:
+static std::string executeLazy(const Command& c, const Args& a)
+{
+	const std::string name = c.name;
+	switch (c.kind) {
+		case Helper:
+			break;
+
+		case Primitive:
+			dag.push_back(defer(c, a, {}));
+			if (verbose) std::cout << name << (a.empty() ? "" : ": ") << argText(a) << "\n";
+			break;
+
+		case Operator:
+			if (dag.empty()) return name+": no meshes";
+			if (verbose) std::cout << name << (all ? "(all)" : "(last)") << (a.empty() ? "" : ": ") << argText(a) << "\n";
+			for (size_t i = all ? 0 : dag.size()-1; i<dag.size(); i++) {
+				if (c.matrix && dag[i]->command && dag[i]->command->matrix) {
+					dag[i]->matrix = compose(c.matrix(a), dag[i]->matrix);
+					continue;
 				}
+				std::vector<std::unique_ptr<Node>> operand;
+				operand.push_back(std::move(dag[i]));
+				dag[i] = defer(c, a, std::move(operand));
 			}
-			else {
-				if (verbose) std::cout << "simplify(last): " << s << "...";
-				int before = m[m.size()-1].NumTri();
-				m[m.size()-1] = m[m.size()-1].Simplify(s);
-				int after = m[m.size()-1].NumTri();
-				if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
-			}
+			break;
+
+		case Aggregator: {
+			flatten(c, dag);
+			std::unique_ptr<Node> n = defer(c, a, std::move(dag));
+			dag.clear();
+			dag.push_back(std::move(n));
+			if (verbose) std::cout << name << "\n";
+			break;
 		}
-		else return "simplify: no parameter";
-	}
-		
-	else if (t[0] == "refine") { //cmd --refine:n
-		if (t.size() == 2) {
-			int n = toI(t[1]);
-			if (all) {
-				if (verbose) std::cout << "refine(all): " << n << "..." << std::endl;
-				for (auto &mm : m) {
-					int before = mm.NumTri();
-					mm = mm.Refine(n);
-					int after = mm.NumTri();
-					if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+	}
+	return "";
+}
+
+//Consecutive transform operators (translate, rotate, scale, transform:matrix) only
+//multiply into a pending matrix per mesh; the next command of any other kind applies 
+//it with one Transform() first, so a run of them walks the list's meshes once.
+static std::vector<manifold::mat3x4> pending;
+
+static void flushTransforms()
+{
+	parallelFor(std::min(pending.size(), m.size()), [&](size_t i) {
+		if (!isIdentity(pending[i])) m[i] = m[i].Transform(pending[i]);
+	});
+	pending.clear();
+}
+
+//runs one command with arguments already checked by parseArgs():
+static std::string executeCommand(const Command& c, const Args& a)
+{
+	const std::string name = c.name;
+	try {
+		if (!c.matrix) flushTransforms();
+		if (lazy && c.kind != Helper) return executeLazy(c, a);
+		switch (c.kind) {
+			case Helper: {
+				if (!lazy) return c.run(a);
+				if (c.reads) evaluateAll();
+				std::string r = c.run(a);
+				//what it left in m (read, or loaded) goes back in the lazy list:
+				if (lazy) {
+					for (auto &mm : m) dag.push_back(leaf(mm));
+					m.clear();
 				}
+				return r;
 			}
-			else {
-				if (verbose) std::cout << "refine(last): " << n << "...";
-				int before = m[m.size()-1].NumTri();
-				m[m.size()-1] = m[m.size()-1].Refine(n);
-				int after = m[m.size()-1].NumTri();
-				if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
-			}
-		}
-		else return "refine: no parameter";
-	}
-		
-	else if (t[0] == "refinetolength") { //cmd --refinetolength:l
-		if (t.size() == 2) {
-			double l = toD(t[1]);
-			if (all) {
-				if (verbose) std::cout << "refinetolength(all): " << l << "..." << std::endl;
-				for (auto &mm : m) {
-					int before = mm.NumTri();
-					mm = mm.RefineToLength(l);
-					int after = mm.NumTri();
-					if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+
+			case Primitive:
+				m.push_back(c.make(a));
+				if (verbose) std::cout << name << ": " << argText(a) << (a.empty() ? "" : " ") << manifoldError(m.back().Status()) << "\n";
+				break;
+
+			case Operator: {
+				if (m.empty()) return name+": no meshes";
+				if (verbose) {
+					std::cout << name << (all ? "(all)" : "(last)");
+					if (!a.empty()) std::cout << ": " << argText(a);
+					if (c.report) std::cout << (all ? "...\n" : "...");
+					else std::cout << "\n";
 				}
-			}
-			else {
-				if (verbose) std::cout << "refinetolength(last): " << l << "...";
-				int before = m[m.size()-1].NumTri();
-				m[m.size()-1] = m[m.size()-1].RefineToLength(l);
-				int after = m[m.size()-1].NumTri();
-				if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
-			}
-		}
-		else return "refinetolength: no parameter";
-	}
-		
-	else if (t[0] == "refinetotolerance") { //cmd --refinetotolerance:t
-		if (t.size() == 2) {
-			double tl = toD(t[1]);
-			if (all) {
-				if (verbose) std::cout << "refinetotolerance(all): " << tl << "..." << std::endl;
-				for (auto &mm : m) {
-					int before = mm.NumTri();
-					mm = mm.RefineToTolerance(tl);
-					int after = mm.NumTri();
-					if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+				if (c.matrix) {
+					manifold::mat3x4 t = c.matrix(a);
+					if (pending.empty()) pending.assign(m.size(), identity());
+					for (size_t i = all ? 0 : m.size()-1; i<m.size(); i++)
+						pending[i] = compose(t, pending[i]);
+					break;
 				}
+				//the meshes are independent, so transform:all works on them in parallel; 
+				//the triangle counts are kept to be reported in list order:
+				size_t first = all ? 0 : m.size()-1, n = m.size() - first;
+				std::vector<size_t> before(n), after(n);
+				parallelFor(n, [&](size_t k) {
+					manifold::Manifold& mm = m[first+k];
+					if (verbose && c.report) before[k] = mm.NumTri();
+					mm = c.apply(mm, a);
+					if (verbose && c.report) after[k] = mm.NumTri();
+				});
+				if (verbose && c.report)
+					for (size_t k=0; k<n; k++)
+						std::cout << " (triangles: " << before[k] << "/" << after[k] << ")\n";
+				break;
 			}
-			else {
-				if (verbose) std::cout << "refinetotolerance(last): " << tl << "...";
-				int before = m[m.size()-1].NumTri();
-				m[m.size()-1] = m[m.size()-1].RefineToTolerance(tl);
-				int after = m[m.size()-1].NumTri();
-				if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
-			}
-		}
-		else return "refinetotolerance: no parameter";
-	}
-		
-	else if (t[0] == "smoothout") { //cmd --smoothout:[msa[,ms]]		
-		double msa=60.0;
-		double ms=0;
-		if (t.size() == 2) {
-			std::vector<std::string> p = split(t[1], ",");
-				
-			if (p.size() >= 1) {
-				msa = toD(p[0]);
-			}
-			if (p.size() >= 2) {
-				ms = toD(p[1]);
-			}
-		}
-		if (all) {
-			if (verbose) std::cout << "smoothout(all): " << msa << "," << ms << "..." << std::endl;
-			for (auto &mm : m) {
-				int before = mm.NumTri();
-				mm = mm.SmoothOut(msa, ms);
-				int after = mm.NumTri();
-				if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+
+			case Aggregator: {
+				manifold::Manifold r = c.combine(m);
+				m.clear();
+				m.push_back(r);
+				if (verbose) std::cout << name << "\n";
+				break;
 			}
 		}
+	}
+	catch (std::exception& e) {
+		return name+": "+e.what();
+	}
+	return "";
+}
+
+
+//A command compiled from its text: looked up, and its arguments split, checked and
+//evaluated, so running it does no parsing.  Scripts are compiled whole before
+//anything runs, so a typo on the last line doesn't cost the work before it.
+struct Instruction {
+	const Command *command;
+	Args args;
+	unsigned line;  //script line, or command-line parameter number
+};
+
+//whether n arguments fit the command's spec:
+static bool takes(const Command& c, size_t n)
+{
+	size_t required = 0, total = 0;
+	bool optional = false;
+	for (const char *s = c.spec; *s; s++) {
+		if (*s == '*') return n >= required;
+		if (*s == '|') optional = true;
 		else {
-			if (verbose) std::cout << "smoothout(last): " << msa << "," << ms << "...";
-			int before = m[m.size()-1].NumTri();
-			m[m.size()-1] = m[m.size()-1].SmoothOut(msa, ms);
-			int after = m[m.size()-1].NumTri();
-			if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+			total++;
+			if (!optional) required++;
 		}
 	}
-		
-	else if (t[0] == "smoothbynormals") { //cmd --smoothbynormals
-		double msa=60.0;
-		double ms=0;
-		if (t.size() >= 1) {
-			if (verbose) std::cout << "smoothbynormals... " ;
-			int before = m[m.size()-1].NumTri();
-			m[m.size()-1] = m[m.size()-1].SmoothByNormals(0);
-			int after = m[m.size()-1].NumTri();
-			if (verbose) std::cout << " (triangles: " << before << "/" << after << ")" << std::endl;
+	return n >= required && n <= total;
+}
+
+static std::string compile(const std::string& parameter, unsigned line, Instruction& ins)
+{
+	size_t colon = parameter.find(':');
+	size_t len = colon == std::string::npos ? parameter.size() : colon;
+	ins.command = commandTable.find(parameter.data(), len);
+	ins.line = line;
+	if (!ins.command) return "Unrecognized command: "+parameter.substr(0, len);
+	std::string text = colon == std::string::npos ? "" : parameter.substr(colon+1);
+	
+	//overloads follow their first row in commands[]; pick the one that takes this many arguments:
+	size_t n = text.empty() ? 0 : std::count(text.begin(), text.end(), ',') + 1;
+	for (const Command *c = ins.command; c < commands+commandCount && strcmp(c->name, ins.command->name) == 0; c++) {
+		if (takes(*c, n)) {
+			ins.command = c;
+			break;
 		}
 	}
-		
-		
-	//cmd -aggregators:
-		
-	else if (t[0] == "union") { //cmd --union
-		if (verbose) std::cout << "union" << std::endl;
-		manifold::Manifold u = manifold::Manifold::BatchBoolean(m, manifold::OpType::Add);
-		m.clear();
-		m.push_back(u);
-	}
-		
-	else if (t[0] == "subtract") { //cmd --subtract
-		manifold::Manifold s = manifold::Manifold::BatchBoolean(m, manifold::OpType::Subtract);
-		m.clear();
-		m.push_back(s);
-		if (verbose) std::cout << "subtract" << std::endl;
-	}
-		
-	else if (t[0] == "intersect") { //cmd --intersect
-		manifold::Manifold i = manifold::Manifold::BatchBoolean(m, manifold::OpType::Intersect);
-		m.clear();
-		m.push_back(i);
-		if (verbose) std::cout << "intersect" << std::endl;
+	return parseArgs(*ins.command, text, ins.args);
+}
+
+//compiles all the parameters, then runs them; errors are reported with where 
+//they were found (what, e.g. "line"), and end the program:
+static void run(const std::vector<std::string>& parameters, const std::vector<unsigned>& lines, const std::string& what)
+{
+	std::vector<Instruction> program(parameters.size());
+	for (size_t i=0; i<parameters.size(); i++) {
+		std::string result = compile(parameters[i], lines[i], program[i]);
+		if (result.size() > 0) err(what + " " + std::to_string(lines[i]) + ": " + result);
 	}
-		
-	else if (t[0] == "hull") { //cmd --hull
-		manifold::Manifold u = manifold::Manifold::Hull(m);
-		m.clear();
-		m.push_back(u);
-		if (verbose) std::cout << "hull" << std::endl;
+	for (auto &ins : program) {
+		std::string result = executeCommand(*ins.command, ins.args);
+		if (result.size() > 0) err(what + " " + std::to_string(ins.line) + ": " + result);
+		std::cout.flush();
 	}
-	else return "Unrecognized command: "+t[0];
-	
-	return "";
 }
 
+std::string executeParameter(std::string parameter)
+{
+	Instruction ins;
+	std::string e = compile(parameter, 0, ins);
+	if (!e.empty()) return e;
+	return executeCommand(*ins.command, ins.args);
+}
 
 
 int main(int argc, char **argv)
 {
+	//console output is written with '\n' into std::cout's own buffer, and flushed 
+	//once per command instead of per line; reading std::cin flushes the shell prompt.
+	std::ios::sync_with_stdio(false);
+	
 	if(argc == 1) {
-		std::cout << "shell mode..." << std::endl;
+		std::cout << "shell mode...\n";
 		std::string param;
 		while (1) {
 			std::cout << "> ";
-			std::getline(std::cin, param);
+			if (!std::getline(std::cin, param)) break;
 			std::string result = executeParameter(param);
-			if (result.size() > 0) std::cout << executeParameter(param) << std::endl;
+			if (result.size() > 0) std::cout << result << "\n";
+			std::cout.flush();
 		}
 	}
 	
 	else if (argc == 2 && std::filesystem::exists(std::string(argv[1]))) {
-		std::cout << "script mode..." << std::endl;
+		std::cout << "script mode...\n";
 		std::string fname = argv[1];
 		std::string param; 
+		std::vector<std::string> params;
+		std::vector<unsigned> lines;
 		std::ifstream file(fname);
 		if (!file.is_open()) err("File open failed: " + fname);
+		unsigned line = 0;
 		while (std::getline(file, param)) {
+			line++;
 			std::vector<std::string> l = split(param, "#");  //parse out comments
 			if (l.size() >= 1 && l[0].size() > 0) {
-				std::string result = executeParameter(l[0]);
-				if (result.size() > 0) err(result);
+				params.push_back(l[0]);
+				lines.push_back(line);
 			}
 		}
 		file.close();
+		run(params, lines, "line");
 	}
 
 	else {
-		std::cout << "command-line mode..." << std::endl;
+		std::cout << "command-line mode...\n";
+		std::vector<std::string> params;
+		std::vector<unsigned> lines;
 		for(int i=1; i<argc; i++) {
-			std::string param = std::string(argv[i]);
-			std::string result = executeParameter(param);
-			if (result.size() > 0) err(result);
+			params.push_back(std::string(argv[i]));
+			lines.push_back(i);
 		}
+		run(params, lines, "parameter");
 	}
 	
 	exit(EXIT_SUCCESS);
@@ -1,667 +1,1850 @@
 
 
 #include "manifold/meshIO.h"
+#include "manifoldIO.h"
 
 #include "miniz.h"
-#include "rapidxml.hpp"
+#include "parallel.h"
+#include "mappedfile.h"
+#include "weldkey.h"
 
 #include <iostream>
 #include <fstream>
 //#include <ios>
 #include <sstream>
 #include <iomanip>  // std::setiosflags, std::setprecision
+#include <charconv>
+#include <string_view>
 
 #include <map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <filesystem>
+#include <memory>
 
 
 //3MF functions:
 
-manifold::Manifold ImportMesh3MF(const std::string& filename)
+// Model3MFParser: a streaming tokenizer for the 3MF core mesh schema.  The
+// model document is inflated a block at a time and each tag is decoded as
+// soon as it is complete, <vertex> and <triangle> going straight into the
+// MeshGL arrays.  No DOM is built, and no more of the document than one
+// block (plus a tag split across blocks) is ever in memory.
+
+class Model3MFParser
 {
-	manifold::MeshGL mesh;
+public:
+	bool parse(const std::string& filename);
 
-	mz_zip_archive zip_archive;
-    mz_bool status;
-    int i;
-    int file_index = -1;
-    const char* model_file_name = "3D/3dmodel.model"; // Standard path in 3MF
-
-    // 1. Initialize the zip archive struct
-    memset(&zip_archive, 0, sizeof(zip_archive));
-
-    // 2. Open the 3MF file (as a zip) for reading
-    status = mz_zip_reader_init_file(&zip_archive, filename.c_str(), 0);
-    if (!status) {
-		return mesh;
-	}
-
-    // 3. Search for the main model file within the archive
-    for (i = 0; i < (int)mz_zip_reader_get_num_files(&zip_archive); ++i) {
-        char current_filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
-		if (mz_zip_reader_get_filename(&zip_archive, i, current_filename, sizeof(current_filename))) {
-
-            if (strcmp(model_file_name, current_filename) == 0) {
-                file_index = i;
-                break;
-            }
-        }
-    }
-
-    if (file_index == -1) {
-        mz_zip_reader_end(&zip_archive);
-        return mesh;
-    }
-
-    // 4. Extract the file content into a buffer
-    size_t uncomp_size;
-    void* uncomp_data = mz_zip_reader_extract_to_heap(&zip_archive, file_index, &uncomp_size, 0);
-    if (!uncomp_data) {
-        mz_zip_reader_end(&zip_archive);
-        return mesh;
-    }
-
-    //printf("Successfully extracted '%s'. Size: %zu bytes.\n", model_file_name, uncomp_size);
-	//std::cout << std::string((char *) uncomp_data) << std::endl;
-	//fflush(stdout);
-
-	rapidxml::xml_document<> doc;    // character type defaults to char
-	doc.parse<0>((char *) uncomp_data);    // 0 means default parse flags
-	
-	rapidxml::xml_node<>* root_node = doc.first_node("model");
-	
-	if (root_node) {
-		
-		rapidxml::xml_node<>* vertices = doc.first_node("model")->first_node("resources")->first_node("object")->first_node("mesh")->first_node("vertices");
-		
-		rapidxml::xml_node<>* vert = vertices->first_node();
-		int vcount = 0;
-		while(vert) {
-			float v[3];
-			v[0] = atof(vert->first_attribute("x")->value()); 
-			v[1] = atof(vert->first_attribute("y")->value()); 
-			v[2] = atof(vert->first_attribute("z")->value()); 
-			mesh.vertProperties.insert(mesh.vertProperties.end(), {v[0], v[1], v[2]});
-			vcount++;
-			vert = vert->next_sibling();
-		}
-		//printf("Vertices: %d\n", vcount);
-
-		rapidxml::xml_node<>* triangles = doc.first_node("model")->first_node("resources")->first_node("object")->first_node("mesh")->first_node("triangles");
-	
-		rapidxml::xml_node<>* tri = triangles->first_node();
-		int tcount = 0;
-		while(tri) {
-			uint32_t t[3];
-			t[0] = atoi(tri->first_attribute("v1")->value()); 
-			t[1] = atoi(tri->first_attribute("v2")->value()); 
-			t[2] = atoi(tri->first_attribute("v3")->value()); 
-			mesh.triVerts.insert(mesh.triVerts.end(), {t[0], t[1], t[2]});
-			tcount++;
-			tri = tri->next_sibling();
-		}
-		//printf("Faces: %d\n", tcount);
-		fflush(stdout);
+	std::vector<manifold::MeshGL> meshes;
+
+private:
+	size_t scan(const char *b, const char *e, bool last);
+	void element(const char *b, const char *e);
+	void vertex(const char *b, const char *e);
+	void triangle(const char *b, const char *e);
+	void reserveVertices(const char *at);
+	void reserveTriangles();
+
+	bool inMesh = false;
+
+	mz_uint64 docSize = 0;    //uncompressed size of the model document
+	mz_uint64 docOffset = 0;  //document offset of base, the start of the block being scanned
+	const char *base = NULL;
+
+	static const size_t blockSize = 1 << 16;
+	static const size_t vertexBytes = 80;
+};
+
+static bool is(const char *b, const char *e, const char *s)
+{
+	size_t l = strlen(s);
+	return (size_t) (e - b) == l && memcmp(b, s, l) == 0;
+}
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+//calls f(name, nameend, value, valueend) for each name="value" in a tag, b..e being the text after the element name:
+template<class F>
+static void attributes(const char *b, const char *e, F f)
+{
+	const char *p = b;
+	while (p < e) {
+		while (p < e && isSpace(*p)) p++;
+		const char *n = p;
+		while (p < e && *p != '=' && !isSpace(*p)) p++;
+		const char *ne = p;
+		while (p < e && *p != '"' && *p != '\'') p++;
+		if (p == e) return;
+		char q = *p++;
+		const char *v = p;
+		while (p < e && *p != q) p++;
+		f(n, ne, v, p);
+		p++;
 	}
+}
 
-    mz_free(uncomp_data);
-    mz_zip_reader_end(&zip_archive);
+//from_chars, but accepting the leading '+' XML numbers may have:
+template<class T>
+static const char *number(const char *b, const char *e, T& v)
+{
+	if (b < e && *b == '+') b++;
+	std::from_chars_result r = std::from_chars(b, e, v);
+	return r.ec == std::errc() ? r.ptr : NULL;
+}
 
-	return manifold::Manifold(mesh);
+//positional decoding of one name="number" attribute, for the layout nearly every 
+//writer uses; returns NULL if the next attribute isn't 'name', or isn't double-quoted:
+template<class T>
+static const char *attribute(const char *p, const char *e, const char *name, T& v)
+{
+	while (p < e && isSpace(*p)) p++;
+	for (; *name; name++, p++)
+		if (p == e || *p != *name) return NULL;
+	if (e - p < 2 || p[0] != '=' || p[1] != '"') return NULL;
+	p = number(p + 2, e, v);
+	if (!p || p == e || *p != '"') return NULL;
+	return p + 1;
 }
 
-std::vector<manifold::Manifold> ImportMeshes3MF(const std::string& filename)
+void Model3MFParser::vertex(const char *b, const char *e)
 {
-	//std::vector<manifold::MeshGL> meshes;
-	std::vector<manifold::Manifold> meshes;
+	float v[3] = {0, 0, 0};
+	const char *p = b;
+	if (!((p = attribute(p, e, "x", v[0])) && (p = attribute(p, e, "y", v[1])) && (p = attribute(p, e, "z", v[2])))) {
+		v[0] = v[1] = v[2] = 0;
+		attributes(b, e, [&](const char *n, const char *ne, const char *val, const char *ve) {
+			if (ne - n == 1 && *n >= 'x' && *n <= 'z') 
+				number(val, ve, v[*n - 'x']);
+		});
+	}
+	manifold::MeshGL& m = meshes.back();
+	m.vertProperties.insert(m.vertProperties.end(), {v[0], v[1], v[2]});
+}
 
-	mz_zip_archive zip_archive;
-    mz_bool status;
-    int i;
-    int file_index = -1;
-    const char* model_file_name = "3D/3dmodel.model"; // Standard path in 3MF
+void Model3MFParser::triangle(const char *b, const char *e)
+{
+	uint32_t t[3] = {0, 0, 0};
+	const char *p = b;
+	if (!((p = attribute(p, e, "v1", t[0])) && (p = attribute(p, e, "v2", t[1])) && (p = attribute(p, e, "v3", t[2])))) {
+		t[0] = t[1] = t[2] = 0;
+		attributes(b, e, [&](const char *n, const char *ne, const char *val, const char *ve) {
+			if (ne - n == 2 && n[0] == 'v' && n[1] >= '1' && n[1] <= '3') 
+				number(val, ve, t[n[1] - '1']);
+		});
+	}
+	manifold::MeshGL& m = meshes.back();
+	m.triVerts.insert(m.triVerts.end(), {t[0], t[1], t[2]});
+}
 
-    // 1. Initialize the zip archive struct
-    memset(&zip_archive, 0, sizeof(zip_archive));
+//3MF carries no element counts, so the arrays are sized from what's left of the document
+//(at least vertexBytes per vertex, counting its share of the triangles), and trimmed if 
+//that turns out too generous, e.g. with more objects to follow:
+void Model3MFParser::reserveVertices(const char *at)
+{
+	mz_uint64 pos = docOffset + (at - base);
+	mz_uint64 remaining = pos < docSize ? docSize - pos : 0;
+	meshes.back().vertProperties.reserve(3 * (remaining / vertexBytes));
+}
 
-    // 2. Open the 3MF file (as a zip) for reading
-    status = mz_zip_reader_init_file(&zip_archive, filename.c_str(), 0);
-    if (!status) {
-		return meshes;
+//a closed mesh has about twice as many triangles as vertices:
+void Model3MFParser::reserveTriangles()
+{
+	manifold::MeshGL& m = meshes.back();
+	if (m.vertProperties.capacity() > 2 * m.vertProperties.size()) 
+		m.vertProperties.shrink_to_fit();
+	m.triVerts.reserve(3 * (2 * m.vertProperties.size() / 3 + 16));
+}
+
+//one tag, b..e being the text between '<' and '>'.  Prefixed (extension namespace) elements are skipped:
+void Model3MFParser::element(const char *b, const char *e)
+{
+	bool end = *b == '/';
+	if (end) b++;
+	bool empty = e > b && e[-1] == '/';
+	if (empty) e--;
+
+	const char *n = b;
+	while (n < e && !isSpace(*n)) n++;
+
+	if (end) {
+		if (inMesh && is(b, n, "mesh")) inMesh = false;
+	}
+	else if (inMesh && is(b, n, "vertex"))
+		vertex(n, e);
+	else if (inMesh && is(b, n, "triangle"))
+		triangle(n, e);
+	else if (is(b, n, "mesh")) {
+		meshes.emplace_back();
+		inMesh = !empty;
 	}
+	else if (inMesh && is(b, n, "vertices"))
+		reserveVertices(e);
+	else if (inMesh && is(b, n, "triangles"))
+		reserveTriangles();
+}
 
-    // 3. Search for the main model file within the archive
-    for (i = 0; i < (int)mz_zip_reader_get_num_files(&zip_archive); ++i) {
-        char current_filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
-		if (mz_zip_reader_get_filename(&zip_archive, i, current_filename, sizeof(current_filename))) {
-
-            if (strcmp(model_file_name, current_filename) == 0) {
-                file_index = i;
-                break;
-            }
-        }
-    }
-
-    if (file_index == -1) {
-        mz_zip_reader_end(&zip_archive);
-        return meshes;
-    }
-
-    // 4. Extract the file content into a buffer
-    size_t uncomp_size;
-    void* uncomp_data = mz_zip_reader_extract_to_heap(&zip_archive, file_index, &uncomp_size, 0);
-    if (!uncomp_data) {
-        mz_zip_reader_end(&zip_archive);
-        return meshes;
-    }
-	
-	//rapidxml seems to add non printable characters to XML string, sometimes...
-	std::string uc = std::string((char *) uncomp_data);
-	if (uc.size() > uncomp_size)
-		uc.resize(uncomp_size);
-
-    //printf("Successfully extracted '%s'. Size: %zu bytes.\n", model_file_name, uncomp_size);
-	//std::string uc = std::string((char *) uncomp_data);
-	//std::cout << uc << std::endl << uc.size() << " characters" << std::endl;
-	//std::cout << std::string((char *) uncomp_data) << std::endl << "end of text, " << std::string((char *) uncomp_data).size() << " characters." << std::endl;
-	//std::cout << uncomp_data << std::endl << "end of text." << std::endl;
-	//fflush(stdout);
-
-	rapidxml::xml_document<> doc;    // character type defaults to char
-	//doc.parse<0>((char *) uncomp_data);    // 0 means default parse flags
-	doc.parse<0>((char *) uc.c_str());  // use resized string, if it was bigger than uncomp_size
-	
-	rapidxml::xml_node<>* root_node = doc.first_node("model");
-	
-	if (root_node) {
-		
-		rapidxml::xml_node<>* obj = doc.first_node("model")->first_node("resources")->first_node("object");
-		
-		while(obj) {
-			//printf("Object:\n");
-			
-			rapidxml::xml_node<>* mesh = obj->first_node("mesh");
-			
-			while(mesh) {
-			
-				rapidxml::xml_node<>* vertices = mesh->first_node("vertices");
-			
-				manifold::MeshGL m;
-		
-				rapidxml::xml_node<>* vert = vertices->first_node();
-				int vcount = 0;
-				while(vert) {
-					float v[3];
-					v[0] = atof(vert->first_attribute("x")->value()); 
-					v[1] = atof(vert->first_attribute("y")->value()); 
-					v[2] = atof(vert->first_attribute("z")->value()); 
-					m.vertProperties.insert(m.vertProperties.end(), {v[0], v[1], v[2]});
-					vcount++;
-					vert = vert->next_sibling();
+//decodes every complete tag in b..e, returning the number of bytes consumed; 
+//the rest (a tag cut off by the end of the block) is rescanned with the next block:
+size_t Model3MFParser::scan(const char *b, const char *e, bool last)
+{
+	const char *p = b;
+	base = b;
+	while (true) {
+		const char *lt = (const char *) memchr(p, '<', e - p);
+		if (!lt) return e - b;  //character data, skipped
+		if (!last && e - lt < 16) return lt - b;  //too short to tell a comment from a tag yet
+
+		const char *q = lt + 1;
+		const char *gt = NULL;
+		auto find = [&](const char *s, size_t l) -> const char * {
+			const char *f = std::search(q, e, s, s + l);
+			return f == e ? NULL : f + l - 1;
+		};
+
+		if (e - q >= 3 && memcmp(q, "!--", 3) == 0)
+			gt = find("-->", 3);
+		else if (e - q >= 8 && memcmp(q, "![CDATA[", 8) == 0)
+			gt = find("]]>", 3);
+		else if (*q == '?')
+			gt = find("?>", 2);
+		else if (*q == '!')
+			gt = find(">", 1);
+		else {
+			char quote = 0;  //'>' is legal inside attribute values
+			for (const char *c = q; c < e; c++) {
+				if (quote) {
+					if (*c == quote) quote = 0;
 				}
-				//printf("\tVertices: %d\n", vcount);
-
-				rapidxml::xml_node<>* triangles = mesh->first_node("triangles");
-	
-				rapidxml::xml_node<>* tri = triangles->first_node();
-				int tcount = 0;
-				while(tri) {
-					uint32_t t[3];
-					t[0] = atoi(tri->first_attribute("v1")->value()); 
-					t[1] = atoi(tri->first_attribute("v2")->value()); 
-					t[2] = atoi(tri->first_attribute("v3")->value()); 
-					m.triVerts.insert(m.triVerts.end(), {t[0], t[1], t[2]});
-					tcount++;
-					tri = tri->next_sibling();
+				else if (*c == '"' || *c == '\'') quote = *c;
+				else if (*c == '>') {
+					gt = c;
+					break;
 				}
-				//printf("\tFaces: %d\n", tcount); fflush(stdout);
-			
-				meshes.push_back(manifold::Manifold(m));
-				mesh = mesh->next_sibling();
-				
 			}
-			
-			obj = obj->next_sibling();
+			if (gt) element(q, gt);
 		}
+
+		if (!gt) return lt - b;
+		p = gt + 1;
 	}
+}
+
+bool Model3MFParser::parse(const std::string& filename)
+{
+	const char* model_file_name = "3D/3dmodel.model"; // Standard path in 3MF
+
+	mz_zip_archive zip_archive;
+	memset(&zip_archive, 0, sizeof(zip_archive));
+	if (!mz_zip_reader_init_file(&zip_archive, filename.c_str(), 0))
+		return false;
+
+	mz_zip_reader_extract_iter_state *it = mz_zip_reader_extract_file_iter_new(&zip_archive, model_file_name, MZ_ZIP_FLAG_CASE_SENSITIVE);
+	if (!it) {
+		mz_zip_reader_end(&zip_archive);
+		return false;
+	}
+
+	docSize = it->file_stat.m_uncomp_size;
+	docOffset = 0;
+
+	std::vector<char> buf(2 * blockSize);
+	size_t have = 0;
+	while (true) {
+		if (buf.size() - have < blockSize) buf.resize(have + blockSize);  //a tag longer than a block
+		size_t n = mz_zip_reader_extract_iter_read(it, buf.data() + have, blockSize);
+		have += n;
+		bool last = n == 0;
+		size_t used = scan(buf.data(), buf.data() + have, last);
+		memmove(buf.data(), buf.data() + used, have - used);
+		have -= used;
+		docOffset += used;
+		if (last) break;
+	}
+
+	bool status = mz_zip_reader_extract_iter_free(it);
+	mz_zip_reader_end(&zip_archive);
+	return status && have == 0 && !inMesh;
+}
+
+manifold::Manifold ImportMesh3MF(const std::string& filename)
+{
+	Model3MFParser parser;
+	if (!parser.parse(filename) || parser.meshes.empty()) 
+		return manifold::Manifold();
+	return manifold::Manifold(parser.meshes[0]);
+}
+
+std::vector<manifold::Manifold> ImportMeshes3MF(const std::string& filename)
+{
+	std::vector<manifold::Manifold> meshes;
+
+	Model3MFParser parser;
+	if (!parser.parse(filename)) 
+		return meshes;
 
-    mz_free(uncomp_data);
-    mz_zip_reader_end(&zip_archive);
+	//the MeshGLs are decoded in file order; validate them into Manifolds concurrently:
+	meshes.resize(parser.meshes.size());
+	parallelFor(parser.meshes.size(), [&](size_t i) {
+		meshes[i] = manifold::Manifold(parser.meshes[i]);
+		parser.meshes[i] = manifold::MeshGL();
+	});
 	
 	return meshes;
 }
 
 
 
-bool ExportMeshGL3MF(const std::string& filename, const manifold::MeshGL &mesh)
+// Every save is written to <filename>.tmp first and handed to commitTemp() 
+// when it's done: written is whether the temp file came out complete.  Only 
+// then is it renamed over filename, so a failed save leaves any previous file 
+// untouched; otherwise, or if the rename fails, the temp file is removed.
+static bool commitTemp(const std::string& tmpname, const std::string& filename, bool written = true)
 {
-	//manifold::MeshGL mesh = m.GetMeshGL();
-	
-	std::string comment = "";
-	std::string unit = "millimeter";
-	remove(filename.c_str());
-	
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "_rels/", NULL, 0, comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "3D/", NULL, 0, comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	std::ostringstream buffer;
-	
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">" << std::endl;
-	buffer << "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\" />" << std::endl;
-	buffer << "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\" />" << std::endl;
-	buffer << "</Types>" << std::endl;
-	if (!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "[Content_Types].xml", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	buffer.str("");
-	buffer.clear();
+	if (written) {
+		std::error_code ec;
+		std::filesystem::rename(tmpname, filename, ec);
+		if (!ec) return true;
+	}
+	remove(tmpname.c_str());
+	return false;
+}
 
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">" << std::endl;
-	buffer << "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\" />" << std::endl;
-	buffer << "</Relationships>" << std::endl;
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "_rels/.rels", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	buffer.str("");
-	buffer.clear();
-	
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "  <model unit=\"" << unit << "\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/2013/01\">" << std::endl;
-	buffer << "    <resources>" << std::endl;
-	buffer << "      <object id=\"0\" type=\"model\">" << std::endl;
-	buffer << "        <mesh>" << std::endl;
-	buffer << "          <vertices>" << std::endl;
-
-	buffer << std::setiosflags(std::ios_base::fixed);
-	buffer << std::setprecision(18);
-	
-	for (size_t i = 0; i < mesh.NumVert(); ++i) {
-		float v[3];
-		for (int j : {0, 1, 2}) v[j] = mesh.vertProperties[i * mesh.numProp + j];
-		buffer << "            <vertex x=\"" << v[0] << "\" y=\"" << v[1] << "\" z=\"" << v[2] << "\" />" << std::endl;
+// ZipWriter: one miniz writer session per save (init_file, add entries,
+// finalize, end), the archive going to a temp file committed by close().  
+// level is miniz's 0 (store) to 10.
+
+class ZipWriter
+{
+public:
+	ZipWriter(const std::string& filename, mz_uint level);
+	~ZipWriter();
+
+	bool add(const char *name, const std::string& data);
+	bool add(const char *name, mz_file_read_func read, void *opaque, mz_uint64 max_size);
+	bool addParallel(const char *name, mz_file_read_func read, void *opaque);
+	bool close();
+
+private:
+	mz_zip_archive zip_archive;
+	std::string filename, tmpname;
+	mz_uint level;
+	bool open;
+	MZ_TIME_T now;
+};
+
+ZipWriter::ZipWriter(const std::string& fname, mz_uint lvl): filename(fname), tmpname(fname + ".tmp"), level(lvl)
+{
+	memset(&zip_archive, 0, sizeof(zip_archive));
+	now = time(NULL);
+	open = mz_zip_writer_init_file(&zip_archive, tmpname.c_str(), 0);
+}
+
+ZipWriter::~ZipWriter()
+{
+	if (open) {  //abandoned before close(), don't leave the partial archive behind
+		mz_zip_writer_end(&zip_archive);
+		remove(tmpname.c_str());
 	}
+}
 
-	buffer << "          </vertices>" << std::endl;
-	buffer << "          <triangles>" << std::endl;
-	
-	for (size_t i = 0; i < mesh.NumTri(); ++i) {
-		uint32_t t[3];
-		for (int j : {0, 1, 2}) t[j] = mesh.triVerts[3 * i + j];
-		buffer << "            <triangle v1=\"" << t[0] << "\" v2=\"" << t[1] << "\" v3=\"" << t[2] << "\" />" << std::endl;
-	}
-
-	buffer << "          </triangles>" << std::endl;
-	buffer << "        </mesh>" << std::endl;
-	buffer << "      </object>" << std::endl;
-	buffer << "    </resources>" << std::endl;
-	buffer << "    <build>" << std::endl;
-	buffer << "      <item objectid=\"0\" />" << std::endl;
-	buffer << "    </build>" << std::endl;
-	buffer << "  </model>" << std::endl;
-	
-	if (!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "3D/3dmodel.model", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	return true;
-	
+bool ZipWriter::add(const char *name, const std::string& data)
+{
+	if (!open) return false;
+	return mz_zip_writer_add_mem_ex_v2(&zip_archive, name, data.data(), data.size(), NULL, 0, level, 0, 0, &now, NULL, 0, NULL, 0);
 }
 
-bool ExportMesh3MF(const std::string& filename, const manifold::Manifold& m)
+bool ZipWriter::add(const char *name, mz_file_read_func read, void *opaque, mz_uint64 max_size)
 {
-	manifold::MeshGL mesh = m.GetMeshGL();
-	return ExportMeshGL3MF(filename, mesh);
+	if (!open) return false;
+	return mz_zip_writer_add_read_buf_callback(&zip_archive, name, read, opaque, max_size, &now, NULL, 0, level, NULL, 0, NULL, 0);
 }
-				
-bool ExportMeshes3MF(const std::string& filename, const std::vector<manifold::Manifold> ms)
+
+//tdefl_put_buf_func_ptr, collecting one block's deflate output:
+static mz_bool appendDeflated(const void *pBuf, int len, void *pUser)
 {
-	std::string comment = "";
-	std::string unit = "millimeter";
-	remove(filename.c_str());
-	
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "_rels/", NULL, 0, comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "3D/", NULL, 0, comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	std::ostringstream buffer;
-	
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">" << std::endl;
-	buffer << "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\" />" << std::endl;
-	buffer << "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\" />" << std::endl;
-	buffer << "</Types>" << std::endl;
-	if (!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "[Content_Types].xml", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	buffer.str("");
-	buffer.clear();
+	((std::string *) pUser)->append((const char *) pBuf, len);
+	return MZ_TRUE;
+}
 
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">" << std::endl;
-	buffer << "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\" />" << std::endl;
-	buffer << "</Relationships>" << std::endl;
-	if(!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "_rels/.rels", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	
-	buffer.str("");
-	buffer.clear();
-	
-	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	buffer << "  <model unit=\"" << unit << "\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/2013/01\">" << std::endl;
-	buffer << "    <resources>" << std::endl;
-	
-	int id = 0;
-	for (auto msh : ms) {
-		buffer << "      <object id=\"" << id << "\" type=\"model\">" << std::endl;
-		buffer << "        <mesh>" << std::endl;
-		buffer << "          <vertices>" << std::endl;
+//Deflates the entry in independent 1MB blocks across threads (the pigz scheme) and
+//adds it as precompressed data.  Every block ends in a sync flush, so the raw deflate
+//outputs just concatenate, and an empty final block closes the stream.  The source is
+//still read a batch of blocks at a time, but the compressed entry is held until the end.
+bool ZipWriter::addParallel(const char *name, mz_file_read_func read, void *opaque)
+{
+	if (!open) return false;
+	const size_t blockSize = 1 << 20;
+	const size_t batch = 2 * threadCount(std::numeric_limits<size_t>::max());
+	const mz_uint flags = tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY);  //-15: raw deflate
+
+	std::vector<std::string> in(batch), out(batch);
+	std::string deflated;
+	mz_uint64 uncomp_size = 0;
+	mz_ulong crc = MZ_CRC32_INIT;
+	bool done = false;
+
+	while (!done) {
+		size_t n = 0;
+		while (n < batch && !done) {
+			in[n].resize(blockSize);
+			size_t got = read(opaque, uncomp_size, &in[n][0], blockSize);
+			in[n].resize(got);
+			crc = mz_crc32(crc, (const mz_uint8 *) in[n].data(), got);
+			uncomp_size += got;
+			if (got < blockSize) done = true;
+			n++;
+		}
+
+		std::atomic<bool> failed(false);
+		parallelFor(n, [&](size_t i) {
+			out[i].clear();
+			if (in[i].empty()) return;
+			tdefl_compressor *comp = tdefl_compressor_alloc();
+			if (!comp 
+				|| tdefl_init(comp, appendDeflated, &out[i], flags) != TDEFL_STATUS_OKAY 
+				|| tdefl_compress_buffer(comp, in[i].data(), in[i].size(), TDEFL_SYNC_FLUSH) != TDEFL_STATUS_OKAY)
+				failed = true;
+			tdefl_compressor_free(comp);
+		});
+		if (failed) return false;
+
+		for (size_t i=0; i<n; i++) deflated += out[i];
+	}
+	deflated.append("\x03\x00", 2);  //empty final block (BFINAL, fixed Huffman, end-of-block)
 
-		buffer << std::setiosflags(std::ios_base::fixed);
-		buffer << std::setprecision(18);
-		
-		manifold::MeshGL m = msh.GetMeshGL();
+	return mz_zip_writer_add_mem_ex_v2(&zip_archive, name, deflated.data(), deflated.size(), NULL, 0, level | MZ_ZIP_FLAG_COMPRESSED_DATA, uncomp_size, (mz_uint32) crc, &now, NULL, 0, NULL, 0);
+}
 
-		for (size_t i = 0; i < m.NumVert(); ++i) {
-			float v[3];
-			for (int j : {0, 1, 2}) v[j] = m.vertProperties[i * m.numProp + j];
-			buffer << "            <vertex x=\"" << v[0] << "\" y=\"" << v[1] << "\" z=\"" << v[2] << "\" />" << std::endl;
+bool ZipWriter::close()
+{
+	if (!open) return false;
+	bool status = mz_zip_writer_finalize_archive(&zip_archive);
+	if (!mz_zip_writer_end(&zip_archive)) status = false;
+	open = false;
+	return commitTemp(tmpname, filename, status);
+}
+
+
+//writes v at p, in the shortest representation that reads back to the same float, or 
+//fixed at 'precision' decimals with the trailing zeros dropped; at most floatMax chars:
+static const size_t floatMax = 64;
+static char *formatFloat(char *p, float v, int precision)
+{
+	if (precision < 0)
+		return std::to_chars(p, p + floatMax, v).ptr;
+
+	char *e = std::to_chars(p, p + floatMax, v, std::chars_format::fixed, precision).ptr;
+	if (precision > 0) {
+		while (e[-1] == '0') e--;
+		if (e[-1] == '.') e--;
+	}
+	return e;
+}
+
+// Model3MFSource: generates the 3D/3dmodel.model document on demand for
+// mz_zip_writer_add_read_buf_callback(), one chunk at a time.  Peak memory
+// is one chunk plus the MeshGL of the object being written, instead of the
+// whole XML document (twice, with buffer.str()).
+
+class Model3MFSource
+{
+public:
+	Model3MFSource(const std::vector<manifold::Manifold>& meshes, int precision): ms(&meshes), single(NULL), count(meshes.size()), precision(precision) {}
+	Model3MFSource(const manifold::MeshGL& mesh, int precision): ms(NULL), single(&mesh), count(1), precision(precision) {}
+
+	mz_uint64 maxSize() const;
+	static size_t read(void *pOpaque, mz_uint64 file_ofs, void *pBuf, size_t n);
+
+private:
+	enum class Phase { header, object, vertices, triangles, build, done };
+
+	void fill();
+	char *number(char *p, float v) const;
+	const manifold::MeshGL& mesh() const { return single ? *single : current; }
+
+	const std::vector<manifold::Manifold> *ms;
+	const manifold::MeshGL *single;
+	size_t count;
+	int precision;
+
+	manifold::MeshGL current;  //only used for the Manifold list, one object at a time
+	Phase phase = Phase::header;
+	size_t obj = 0;
+	size_t elem = 0;
+
+	std::string chunk;
+	size_t len = 0, pos = 0;
+
+	static const size_t chunkSize = 1 << 16;
+	static const size_t lineMax = 512;  //longest single write to the chunk, a vertex at precision 20
+};
+
+//miniz needs an upper bound on the entry size before the first byte, to decide on zip64:
+mz_uint64 Model3MFSource::maxSize() const
+{
+	const mz_uint64 numberMax = precision < 0 ? 16 : 42 + precision;  //fixed notation of FLT_MAX is 39 digits
+	mz_uint64 verts = 0, tris = 0;
+	if (single) {
+		verts = single->NumVert();
+		tris = single->NumTri();
+	}
+	else {
+		for (auto &msh : *ms) {
+			verts += msh.NumVert() + msh.NumPropVert();
+			tris += msh.NumTri();
 		}
+	}
+	mz_uint64 bound = 1024 + count * 512 + verts * (64 + 3 * numberMax) + tris * (64 + 3 * 10);
+	if (bound < MZ_UINT32_MAX)
+		return MZ_UINT32_MAX;
+	return std::numeric_limits<mz_uint64>::max();
+}
+
+char *Model3MFSource::number(char *p, float v) const
+{
+	return formatFloat(p, v, precision);
+}
 
-		buffer << "          </vertices>" << std::endl;
-		buffer << "          <triangles>" << std::endl;
+void Model3MFSource::fill()
+{
+	const char *unit = "millimeter";
+	chunk.resize(chunkSize + lineMax);
+	char *p = &chunk[0];
+	char *end = p + chunkSize;
+
+	auto put = [&p](const char *s) {
+		size_t l = strlen(s);
+		memcpy(p, s, l);
+		p += l;
+	};
+	auto putint = [&p](uint64_t i) {
+		p = std::to_chars(p, p + 24, i).ptr;
+	};
+
+	while (phase != Phase::done && p < end) {
+		switch (phase) {
+			case Phase::header:
+				put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+				put("  <model unit=\""); put(unit); put("\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/2013/01\">\n");
+				put("    <resources>\n");
+				elem = 0;
+				if (count > 0) 
+					phase = Phase::object;
+				else {
+					put("    </resources>\n");
+					put("    <build>\n");
+					phase = Phase::build;
+				}
+				break;
+
+			case Phase::object:
+				if (!single) current = (*ms)[obj].GetMeshGL();
+				put("      <object id=\""); putint(obj); put("\" type=\"model\">\n");
+				put("        <mesh>\n");
+				put("          <vertices>\n");
+				elem = 0;
+				phase = Phase::vertices;
+				break;
+
+			case Phase::vertices: {
+				const manifold::MeshGL& m = mesh();
+				size_t nv = m.NumVert();
+				while (elem < nv && p < end) {
+					const float *v = &m.vertProperties[elem * m.numProp];
+					put("            <vertex x=\""); p = number(p, v[0]);
+					put("\" y=\""); p = number(p, v[1]);
+					put("\" z=\""); p = number(p, v[2]);
+					put("\" />\n");
+					elem++;
+				}
+				if (elem == nv) {
+					put("          </vertices>\n");
+					put("          <triangles>\n");
+					elem = 0;
+					phase = Phase::triangles;
+				}
+				break;
+			}
+
+			case Phase::triangles: {
+				const manifold::MeshGL& m = mesh();
+				size_t nt = m.NumTri();
+				while (elem < nt && p < end) {
+					const uint32_t *t = &m.triVerts[3 * elem];
+					put("            <triangle v1=\""); putint(t[0]);
+					put("\" v2=\""); putint(t[1]);
+					put("\" v3=\""); putint(t[2]);
+					put("\" />\n");
+					elem++;
+				}
+				if (elem == nt) {
+					put("          </triangles>\n");
+					put("        </mesh>\n");
+					put("      </object>\n");
+					current = manifold::MeshGL();
+					obj++;
+					elem = 0;
+					if (obj < count) 
+						phase = Phase::object;
+					else {
+						put("    </resources>\n");
+						put("    <build>\n");
+						phase = Phase::build;
+					}
+				}
+				break;
+			}
+
+			case Phase::build:
+				while (elem < count && p < end) {
+					put("      <item objectid=\""); putint(elem); put("\" />\n");
+					elem++;
+				}
+				if (elem == count) {
+					put("    </build>\n");
+					put("  </model>\n");
+					phase = Phase::done;
+				}
+				break;
 
-		for (size_t i = 0; i < m.NumTri(); ++i) {
-			uint32_t t[3];
-			for (int j : {0, 1, 2}) t[j] = m.triVerts[3 * i + j];
-			buffer << "            <triangle v1=\"" << t[0] << "\" v2=\"" << t[1] << "\" v3=\"" << t[2] << "\" />" << std::endl;
+			case Phase::done:
+				break;
 		}
+	}
 
-		buffer << "          </triangles>" << std::endl;
-		buffer << "        </mesh>" << std::endl;
-		buffer << "      </object>" << std::endl;
+	len = p - chunk.data();
+	pos = 0;
+}
 
-		id++;
+//mz_file_read_func; miniz pulls the entry sequentially, so file_ofs is implied by what's been handed out:
+size_t Model3MFSource::read(void *pOpaque, mz_uint64, void *pBuf, size_t n)
+{
+	Model3MFSource *src = (Model3MFSource *) pOpaque;
+	size_t total = 0;
+	while (total < n) {
+		if (src->pos == src->len) {
+			if (src->phase == Phase::done) break;
+			src->fill();
+			continue;
+		}
+		size_t l = std::min(n - total, src->len - src->pos);
+		memcpy((char *) pBuf + total, src->chunk.data() + src->pos, l);
+		src->pos += l;
+		total += l;
 	}
+	return total;
+}
+
+static bool Export3MF(const std::string& filename, Model3MFSource& src, const Export3MFOptions& opt)
+{
+	ZipWriter zip(filename, opt.level);
+	
+	if (!zip.add("_rels/", "")) return false;
 	
-	buffer << "    </resources>" << std::endl;
-	buffer << "    <build>" << std::endl;
+	if (!zip.add("3D/", "")) return false;
 	
-	for (int i=0; i<id; i++) 
-		buffer << "      <item objectid=\"" << i << "\" />" << std::endl;
+	std::ostringstream buffer;
 	
-	buffer << "    </build>" << std::endl;
-	buffer << "  </model>" << std::endl;
+	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	buffer << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n";
+	buffer << "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\" />\n";
+	buffer << "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\" />\n";
+	buffer << "</Types>\n";
+	if (!zip.add("[Content_Types].xml", buffer.str())) return false;
 	
-	if (!mz_zip_add_mem_to_archive_file_in_place(filename.c_str(), "3D/3dmodel.model", buffer.str().c_str(), buffer.str().size(), comment.c_str(), comment.size(), MZ_BEST_COMPRESSION)) return false;
-	return true;
+	buffer.str("");
+	buffer.clear();
+
+	buffer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	buffer << "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n";
+	buffer << "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\" />\n";
+	buffer << "</Relationships>\n";
+	if (!zip.add("_rels/.rels", buffer.str())) return false;
+	
+	if (opt.parallel && opt.level > 0) {
+		if (!zip.addParallel("3D/3dmodel.model", Model3MFSource::read, &src)) return false;
+	}
+	else {
+		if (!zip.add("3D/3dmodel.model", Model3MFSource::read, &src, src.maxSize())) return false;
+	}
+	
+	return zip.close();
 }
 
+bool ExportMeshGL3MF(const std::string& filename, const manifold::MeshGL &mesh, const Export3MFOptions& opt)
+{
+	Model3MFSource src(mesh, opt.precision);
+	return Export3MF(filename, src, opt);
+}
+
+bool ExportMesh3MF(const std::string& filename, const manifold::Manifold& m, const Export3MFOptions& opt)
+{
+	manifold::MeshGL mesh = m.GetMeshGL();
+	return ExportMeshGL3MF(filename, mesh, opt);
+}
+				
+bool ExportMeshes3MF(const std::string& filename, const std::vector<manifold::Manifold> ms, const Export3MFOptions& opt)
+{
+	Model3MFSource src(ms, opt.precision);
+	return Export3MF(filename, src, opt);
+}
 
 //STL
 
 //Binary/ASCII STL loader with weld-tolerance dedup courtesy of Microsoft CoPilot:
 #include <fstream>
 #include <sstream>
-#include <unordered_map>
+#include <type_traits>
 
 //using namespace manifold;
 
+// the facet's unit normal: the file's, or from the winding where the file's is 
+// zero (plenty of writers leave it so); zero for a degenerate triangle:
+static Vec3 FacetNormal(const Vec3& n, const Vec3& a, const Vec3& b, const Vec3& c) {
+	Vec3 f = n;
+	float l = std::sqrt(f.x * f.x + f.y * f.y + f.z * f.z);
+	if (!(l > 0.0f) || !std::isfinite(l)) {
+		const Vec3 u = {b.x - a.x, b.y - a.y, b.z - a.z}, v = {c.x - a.x, c.y - a.y, c.z - a.z};
+		f = {u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x};
+		l = std::sqrt(f.x * f.x + f.y * f.y + f.z * f.z);
+		if (!(l > 0.0f) || !std::isfinite(l)) return {0.0f, 0.0f, 0.0f};
+	}
+	return {f.x / l, f.y / l, f.z / l};
+}
+
+// a vertex's summed facet normals (properties 3-5) scaled to unit length:
+static void NormalizeVertexNormal(float *prop) {
+	const float l = std::sqrt(prop[3] * prop[3] + prop[4] * prop[4] + prop[5] * prop[5]);
+	if (l > 0.0f)
+		for (int j = 3; j < 6; j++) prop[j] /= l;
+}
+
 // -----------------------------
-// Hashable Vec3 for dedup
+// Parallel weld
 // -----------------------------
-struct Vec3 {
-	float x, y, z;
-	bool operator==(const Vec3& o) const {
-		return x == o.x && y == o.y && z == o.z;
-	}
-};
+// Corners (three per triangle) that quantize to the same eps cell become one 
+// vertex.  The corners are radix-partitioned by key hash across threads, each 
+// partition is deduplicated on its own, and then the vertices are 
+// numbered in order of their first corner: the same indices a serial pass over 
+// the triangles gives, whatever the thread count.  corner(i) returns corner i; 
+// the keys are requantized in each pass rather than stored.  Given normal(t), 
+// the facet normal of triangle t, each vertex also gets a vertex normal as 
+// properties 3-5: the normalized sum of the unit normals of the facets around it.
+template<class C, class N = std::nullptr_t>
+static manifold::MeshGL WeldSTL(size_t n, C corner, float eps, N normal = nullptr) {
+	constexpr bool withNormals = !std::is_same<N, std::nullptr_t>::value;
+	if (n > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("STL too large to weld");
+
+	const size_t chunk = 65536;
+	const size_t nchunks = (n + chunk - 1) / chunk;
+	const unsigned bits = 8;
+	const size_t nparts = 1 << bits;
+
+	std::vector<uint32_t> counts(nchunks * nparts, 0);
+	auto part = [&](const QuantizedVec3& k) {
+		return (size_t) (QuantizedHash()(k) >> (64 - bits));
+	};
 
-struct Vec3Hash {
-	std::size_t operator()(const Vec3& v) const noexcept {
-		const uint32_t* p = reinterpret_cast<const uint32_t*>(&v);
-		return (size_t)p[0] * 73856093u ^
-				(size_t)p[1] * 19349663u ^
-				(size_t)p[2] * 83492791u;
+	// count each chunk's corners per partition:
+	parallelFor(nchunks, [&](size_t c) {
+		uint32_t *count = &counts[c * nparts];
+		for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+			count[part(Quantize(corner(i), eps))]++;
+	});
+
+	// partition p holds chunk 0's corners, then chunk 1's...; turn the counts into write positions:
+	std::vector<size_t> start(nparts + 1, 0);
+	std::vector<size_t> offsets(nchunks * nparts);
+	size_t pos = 0;
+	for (size_t p = 0; p < nparts; p++) {
+		start[p] = pos;
+		for (size_t c = 0; c < nchunks; c++) {
+			offsets[c * nparts + p] = pos;
+			pos += counts[c * nparts + p];
+		}
 	}
-};
+	start[nparts] = pos;
+	counts = std::vector<uint32_t>();
+
+	std::vector<uint32_t> order(n);
+	parallelFor(nchunks, [&](size_t c) {
+		size_t *offset = &offsets[c * nparts];
+		for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+			order[offset[part(Quantize(corner(i), eps))]++] = i;
+	});
+
+	// rep[i]: the first corner with corner i's key.  Each partition is deduplicated 
+	// through its own flat open-addressing table, at most half full, keyed on the low 
+	// hash bits (the partition took the top ones).  A partition lists its corners in 
+	// file order, so the corner already in a slot is the first one.
+	std::vector<uint32_t> rep(n);
+	parallelFor(nparts, [&](size_t p) {
+		struct Slot { QuantizedVec3 key; uint32_t corner; };
+		const uint32_t empty = std::numeric_limits<uint32_t>::max();
+		size_t size = 16;
+		while (size < (start[p+1] - start[p]) * 2) size *= 2;
+		std::vector<Slot> table(size, Slot{{0, 0, 0}, empty});
+		const size_t mask = size - 1;
+
+		for (size_t o = start[p]; o < start[p+1]; o++) {
+			const uint32_t i = order[o];
+			const QuantizedVec3 k = Quantize(corner(i), eps);
+			size_t h = QuantizedHash()(k) & mask;
+			while (table[h].corner != empty && !(table[h].key == k)) h = (h + 1) & mask;
+			if (table[h].corner == empty) table[h] = Slot{k, i};
+			rep[i] = table[h].corner;
+		}
+	});
+	order = std::vector<uint32_t>();
 
-struct QuantizedVec3 {
-	int x, y, z;
-	bool operator==(const QuantizedVec3& o) const {
-		return x == o.x && y == o.y && z == o.z;
+	// number the vertices in first-corner order, chunk by chunk:
+	std::vector<uint32_t> first(nchunks + 1, 0);
+	parallelFor(nchunks, [&](size_t c) {
+		for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+			if (rep[i] == i) first[c + 1]++;
+	});
+	for (size_t c = 0; c < nchunks; c++) first[c + 1] += first[c];
+
+	manifold::MeshGL mesh;
+	const size_t np = mesh.numProp = withNormals ? 6 : 3;
+	mesh.vertProperties.resize((size_t) first[nchunks] * np);
+	mesh.triVerts.resize(n);
+	parallelFor(nchunks, [&](size_t c) {
+		uint32_t v = first[c];
+		for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+			if (rep[i] != i) continue;
+			float *prop = &mesh.vertProperties[(size_t) v * np];
+			const Vec3 p = corner(i);
+			prop[0] = p.x;
+			prop[1] = p.y;
+			prop[2] = p.z;
+			mesh.triVerts[i] = v++;
+		}
+	});
+	parallelFor(nchunks, [&](size_t c) {
+		for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+			if (rep[i] != i) mesh.triVerts[i] = mesh.triVerts[rep[i]];
+	});
+
+	if constexpr (withNormals) {
+		// the sums go to shared vertices, so they're added up in one pass, and scaled in parallel:
+		for (size_t t = 0; t < n / 3; t++) {
+			const Vec3 f = FacetNormal(normal(t), corner(t * 3), corner(t * 3 + 1), corner(t * 3 + 2));
+			for (size_t j = 0; j < 3; j++) {
+				float *prop = &mesh.vertProperties[(size_t) mesh.triVerts[t * 3 + j] * np];
+				prop[3] += f.x;
+				prop[4] += f.y;
+				prop[5] += f.z;
+			}
+		}
+		parallelFor(nchunks, [&](size_t c) {
+			for (size_t v = first[c]; v < first[c + 1]; v++)
+				NormalizeVertexNormal(&mesh.vertProperties[v * np]);
+		});
 	}
+
+	return mesh;
+}
+
+
+
+// -----------------------------
+// Streaming weld
+// -----------------------------
+// For stream-mode import: triangles are welded one at a time as they're read, 
+// so no corner list is held, just the indices and the unique vertices.  A slot 
+// of the flat table is a vertex index and 32 bits of its key's hash; on a hash 
+// match the key is requantized from the vertex's own position.  The table starts 
+// at one slot per triangle (about two per vertex for a closed mesh), doubling 
+// when half full.  Vertices get the same first-corner numbering, and the same 
+// summed facet normals, as WeldSTL.
+class STLStreamWelder
+{
+public:
+	STLStreamWelder(float eps, bool normals, size_t triangles);
+	void add(const Vec3 *v, const Vec3& n);
+	manifold::MeshGL mesh();
+
+private:
+	struct Slot { uint32_t vertex; uint32_t hash; };
+	static const uint32_t empty = 0xFFFFFFFF;
+
+	uint32_t vertex(const Vec3& v);
+	void grow();
+
+	float eps;
+	size_t np;
+	std::vector<Slot> table;
+	size_t used = 0;
+	std::vector<float> props;
+	std::vector<uint32_t> triVerts;
 };
 
-struct QuantizedHash {
-	size_t operator()(const QuantizedVec3& q) const noexcept {
-		return (size_t)q.x * 73856093u ^
-				(size_t)q.y * 19349663u ^
-				(size_t)q.z * 83492791u;
+STLStreamWelder::STLStreamWelder(float e, bool normals, size_t triangles): eps(e), np(normals ? 6 : 3)
+{
+	size_t size = 16;
+	while (size < triangles) size *= 2;
+	table.assign(size, Slot{empty, 0});
+	triVerts.reserve(triangles * 3);
+	props.reserve(triangles / 2 * np);
+}
+
+uint32_t STLStreamWelder::vertex(const Vec3& v)
+{
+	const QuantizedVec3 k = Quantize(v, eps);
+	const uint64_t hash = QuantizedHash()(k);
+	const size_t mask = table.size() - 1;
+	for (size_t h = hash & mask; ; h = (h + 1) & mask) {
+		Slot& s = table[h];
+		if (s.vertex == empty) {
+			if (props.size() / np >= empty) throw std::runtime_error("STL too large to weld");
+			s = Slot{(uint32_t) (props.size() / np), (uint32_t) (hash >> 32)};
+			props.insert(props.end(), {v.x, v.y, v.z});
+			if (np == 6) props.insert(props.end(), {0.0f, 0.0f, 0.0f});
+			uint32_t idx = s.vertex;
+			if (++used * 2 > table.size()) grow();
+			return idx;
+		}
+		if (s.hash == (uint32_t) (hash >> 32)) {
+			const float *p = &props[(size_t) s.vertex * np];
+			if (Quantize({p[0], p[1], p[2]}, eps) == k) return s.vertex;
+		}
 	}
-};
+}
 
-inline QuantizedVec3 Quantize(const Vec3& v, float eps) {
-	return {
-		int(std::floor(v.x / eps)),
-		int(std::floor(v.y / eps)),
-		int(std::floor(v.z / eps))
-	};
+void STLStreamWelder::grow()
+{
+	std::vector<Slot> old(table.size() * 2, Slot{empty, 0});
+	old.swap(table);
+	const size_t mask = table.size() - 1;
+	for (const Slot& s : old) {
+		if (s.vertex == empty) continue;
+		const float *p = &props[(size_t) s.vertex * np];
+		size_t h = QuantizedHash()(Quantize({p[0], p[1], p[2]}, eps)) & mask;
+		while (table[h].vertex != empty) h = (h + 1) & mask;
+		table[h] = s;
+	}
 }
 
+void STLStreamWelder::add(const Vec3 *v, const Vec3& n)
+{
+	for (int j : {0, 1, 2}) triVerts.push_back(vertex(v[j]));
+	if (np == 6) {
+		const Vec3 f = FacetNormal(n, v[0], v[1], v[2]);
+		for (size_t j = triVerts.size() - 3; j < triVerts.size(); j++) {
+			float *prop = &props[(size_t) triVerts[j] * np];
+			prop[3] += f.x;
+			prop[4] += f.y;
+			prop[5] += f.z;
+		}
+	}
+}
 
+//the table is dropped first, and the arrays are trimmed to their exact size:
+manifold::MeshGL STLStreamWelder::mesh()
+{
+	table = std::vector<Slot>();
+	manifold::MeshGL mesh;
+	mesh.numProp = np;
+	if (np == 6)
+		for (size_t v = 0; v < props.size(); v += np) NormalizeVertexNormal(&props[v]);
+	props.shrink_to_fit();
+	triVerts.shrink_to_fit();
+	mesh.vertProperties = std::move(props);
+	mesh.triVerts = std::move(triVerts);
+	return mesh;
+}
 
 // -----------------------------
 // Helpers
 // -----------------------------
-bool IsASCII_STL(const std::string& filename) {
-	std::ifstream f(filename, std::ios::binary);
-	if (!f) return false;
-
-	char header[80];
-	f.read(header, 80);
+// Plenty of binary writers start the header with "solid" too, so a file that 
+// holds all the records its header's triangle count calls for is taken as binary 
+// when it's exactly that size, or when it's larger (the binary loader ignores 
+// trailing bytes) and its start doesn't read as ASCII STL: a NUL byte, or no 
+// 'facet' keyword, in the first 512 bytes.  Otherwise a leading "solid" means ASCII.
+bool IsASCII_STL(const MappedFile& file) {
+	const char *d = file.data();
+	const size_t size = file.size();
+	if (size >= 84) {
+		uint32_t triCount;
+		memcpy(&triCount, d + 80, 4);
+		const uint64_t expected = 84 + (uint64_t) triCount * 50;
+		if (expected == size) return false;
+		if (expected < size) {
+			const std::string_view head(d, std::min<size_t>(size, 512));
+			if (head.find('\0') != std::string_view::npos || head.find("facet") == std::string_view::npos)
+				return false;
+		}
+	}
 
 	// ASCII STL starts with "solid"
-	std::string s(header, header + 5);
-	return s == "solid";
+	size_t i = 0;
+	while (i < size && isSpace(d[i])) i++;
+	return size - i >= 5 && memcmp(d + i, "solid", 5) == 0;
 }
 
 // -----------------------------
 // ASCII STL Loader
 // -----------------------------
-manifold::MeshGL LoadASCII_STL(const std::string& filename) {
-	std::ifstream file(filename);
-	if (!file) throw std::runtime_error("Cannot open ASCII STL");
+// The mapped file is scanned a whitespace-delimited word at a time; only 'facet 
+// normal' and 'vertex' carry numbers, everything else (outer loop, endloop, 
+// endfacet, the solid name) is passed over.  facet(v, n) is called for every 
+// three vertices, n being the last facet normal (zero when normals is off).
+template<class F>
+static void ScanASCII_STL(const MappedFile& file, bool normals, F facet) {
+	const char *p = file.data(), *e = file.data() + file.size();
+
+	auto word = [&]() {
+		while (p < e && isSpace(*p)) p++;
+		const char *w = p;
+		while (p < e && !isSpace(*p)) p++;
+		return w;
+	};
+	auto vec = [&](Vec3& v) {
+		for (float *f : {&v.x, &v.y, &v.z}) {
+			const char *w = word();
+			if (number(w, p, *f) != p)
+				throw std::runtime_error("ASCII STL: bad number at byte " + std::to_string(w - file.data()));
+		}
+	};
 
-	std::vector<float> positions;
-	std::vector<float> normals;
-	std::vector<uint32_t> indices;
+	Vec3 v[3], n = {0, 0, 0};
+	int corner = 0;
+	while (p < e) {
+		const char *w = word();
+		if (is(w, p, "vertex")) {
+			vec(v[corner++]);
+			if (corner == 3) {
+				facet(v, n);
+				corner = 0;  // a trailing partial facet is dropped
+			}
+		}
+		else if (is(w, p, "facet") && normals) {
+			word(); // "normal"
+			vec(n);
+		}
+		else if (is(w, p, "solid") || is(w, p, "endsolid")) {
+			while (p < e && *p != '\n') p++;  // the name may be any text
+		}
+	}
+}
 
-	float weldEpsilon = 1e-5f;   // tweak as needed
-	std::unordered_map<QuantizedVec3, uint32_t, QuantizedHash> vertMap;
+manifold::MeshGL LoadASCII_STL(const MappedFile& file, const ImportSTLOptions& opt) {
+	if (opt.stream) {
+		STLStreamWelder weld(opt.weld, opt.normals, file.size() / 250);
+		ScanASCII_STL(file, opt.normals, [&](const Vec3 *v, const Vec3& n) { weld.add(v, n); });
+		return weld.mesh();
+	}
 
-	auto addVertex = [&](const Vec3& v, const Vec3& n) {
-		QuantizedVec3 key = Quantize(v, weldEpsilon);
+	std::vector<Vec3> corners;
+	std::vector<Vec3> normals;
 
-		auto it = vertMap.find(key);
-		if (it != vertMap.end()) {
-			return it->second;   // welded match
-		}
+	// a facet with full-precision coordinates is about 250 bytes:
+	corners.reserve(file.size() / 80);
+	if (opt.normals) normals.reserve(file.size() / 240);
 
-		uint32_t idx = positions.size() / 3;
+	ScanASCII_STL(file, opt.normals, [&](const Vec3 *v, const Vec3& n) {
+		corners.insert(corners.end(), v, v + 3);
+		if (opt.normals) normals.push_back(n);
+	});
 
-		positions.push_back(v.x);
-		positions.push_back(v.y);
-		positions.push_back(v.z);
+	auto corner = [&](size_t i) { return corners[i]; };
+	if (opt.normals)
+		return WeldSTL(corners.size(), corner, opt.weld, [&](size_t t) { return normals[t]; });
+	return WeldSTL(corners.size(), corner, opt.weld);
+}
 
-		normals.push_back(n.x);
-		normals.push_back(n.y);
-		normals.push_back(n.z);
+// -----------------------------
+// Binary STL Loader
+// -----------------------------
+manifold::MeshGL LoadBinary_STL(MappedFile& file, const ImportSTLOptions& opt) {
+	if (file.size() < 84) throw std::runtime_error("Binary STL truncated in the header");
 
-		vertMap[key] = idx;
-		return idx;
+	uint32_t triCount;
+	memcpy(&triCount, file.data() + 80, 4);  // after the 80-byte header
+
+	// the records must all be there; trailing bytes past them are ignored
+	if ((uint64_t) triCount * 50 > file.size() - 84)
+		throw std::runtime_error("Binary STL header claims " + std::to_string(triCount) + " triangles, file holds " + std::to_string((file.size() - 84) / 50));
+
+	// the records are decoded straight from the mapping, 50 bytes per triangle: 
+	// normal, three vertices, attribute word
+	const char *data = file.data() + 84;
+
+	// stream mode welds a fixed-size block of records at a time, and lets go of 
+	// each block's pages once it's done:
+	if (opt.stream) {
+		STLStreamWelder weld(opt.weld, opt.normals, triCount);
+		const size_t block = 65536;
+		for (size_t done = 0; done < triCount; done += block) {
+			const size_t count = std::min(block, triCount - done);
+			for (size_t i = done; i < done + count; i++) {
+				Vec3 r[4];
+				memcpy(r, data + i * 50, 48);
+				weld.add(r + 1, r[0]);
+			}
+			file.discard(84 + done * 50, count * 50);
+		}
+		return weld.mesh();
+	}
+
+	auto corner = [&](size_t i) {
+		Vec3 v;
+		memcpy(&v, data + i / 3 * 50 + 12 + i % 3 * 12, 12);
+		return v;
 	};
+	if (opt.normals) {
+		return WeldSTL((size_t) triCount * 3, corner, opt.weld, [&](size_t t) {
+			Vec3 n;
+			memcpy(&n, data + t * 50, 12);
+			return n;
+		});
+	}
+	return WeldSTL((size_t) triCount * 3, corner, opt.weld);
+}
+
+// -----------------------------
+// Unified Loader
+// -----------------------------
+// One mapping serves both the classification and the load.
+manifold::MeshGL LoadSTL_Dedup(const std::string& filename, const ImportSTLOptions& opt) {
+	MappedFile file;
+	if (!file.open(filename)) throw std::runtime_error("Cannot open STL");
+	if (IsASCII_STL(file))
+		return LoadASCII_STL(file, opt);
+	else
+		return LoadBinary_STL(file, opt);
+}
 
+manifold::MeshGL ImportMeshSTL(const std::string& filename, const ImportSTLOptions& opt)
+{
+	manifold::MeshGL mesh = LoadSTL_Dedup(filename, opt);
+	return mesh;
+}
 
-	std::string line;
-	Vec3 normal;
+//one 50-byte record per triangle (facet normal, three vertices, zero attribute word),
+//written straight into the mapped file by chunks of triangles spread over the threads:
+static void writeSTLTriangles(char *dst, const manifold::MeshGL& mesh)
+{
+	const size_t ntri = mesh.NumTri();
+	const size_t chunk = 65536;
+	const float *vp = mesh.vertProperties.data();
+	const uint32_t *tv = mesh.triVerts.data();
+	const size_t np = mesh.numProp;
+
+	parallelFor((ntri + chunk - 1) / chunk, [&](size_t c) {
+		size_t end = std::min(ntri, (c + 1) * chunk);
+		for (size_t i = c * chunk; i < end; i++) {
+			float r[12];
+			for (int j : {0, 1, 2}) {
+				const float *p = vp + tv[3 * i + j] * np;
+				r[3 + 3*j] = p[0];
+				r[4 + 3*j] = p[1];
+				r[5 + 3*j] = p[2];
+			}
 
-	while (std::getline(file, line)) {
-		std::stringstream ss(line);
-		std::string word;
-		ss >> word;
+			float u[3] = {r[6] - r[3], r[7] - r[4], r[8] - r[5]};
+			float v[3] = {r[9] - r[3], r[10] - r[4], r[11] - r[5]};
+			r[0] = u[1]*v[2] - u[2]*v[1];
+			r[1] = u[2]*v[0] - u[0]*v[2];
+			r[2] = u[0]*v[1] - u[1]*v[0];
+			float l = r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+			if (l > 0.0f) {  //degenerate triangles get a zero normal, not NaNs
+				l = 1.0f / std::sqrt(l);
+				r[0] *= l;
+				r[1] *= l;
+				r[2] *= l;
+			}
 
-		if (word == "facet") {
-			ss >> word; // "normal"
-			ss >> normal.x >> normal.y >> normal.z;
+			char *rec = dst + i * 50;
+			memcpy(rec, r, 48);
+			rec[48] = rec[49] = 0;
 		}
-		else if (word == "vertex") {
-			Vec3 v;
-			ss >> v.x >> v.y >> v.z;
-			uint32_t idx = addVertex(v, normal);
-			indices.push_back(idx);
+	});
+}
+
+//A binary file of a size known up front: the temp file is created and mapped, 
+//fill(dst) writes the contents, and it's committed once unmapped:
+template<class F>
+static bool ExportMapped(const std::string& filename, uint64_t size, F fill)
+{
+	std::string tmpname = filename + ".tmp";
+	{
+		MappedFile file;
+		if (!file.create(tmpname, size)) return commitTemp(tmpname, filename, false);
+		fill(file.data());
+	}
+	return commitTemp(tmpname, filename);
+}
+
+//Binary STL of count triangles; fill(dst) writes the records:
+template<class F>
+static bool ExportSTL(const std::string& filename, uint64_t count, F fill)
+{
+	if (count > std::numeric_limits<uint32_t>::max()) return false;
+
+	return ExportMapped(filename, 84 + count * 50, [&](char *dst) {
+		memset(dst, 0, 80);
+		const uint32_t n = count;
+		memcpy(dst + 80, &n, 4);
+		fill(dst + 84);
+	});
+}
+
+bool ExportMeshSTL(const std::string& filename, const manifold::MeshGL& mesh)
+{
+	return ExportSTL(filename, mesh.NumTri(), [&](char *dst) {
+		writeSTLTriangles(dst, mesh);
+	});
+}
+
+//every mesh's triangles in the one file, extracted one MeshGL at a time:
+bool ExportMeshesSTL(const std::string& filename, const std::vector<manifold::Manifold>& meshes)
+{
+	uint64_t count = 0;
+	for (auto &m : meshes) count += m.NumTri();
+	return ExportSTL(filename, count, [&](char *dst) {
+		for (auto &m : meshes) {
+			manifold::MeshGL mesh = m.GetMeshGL();
+			writeSTLTriangles(dst, mesh);
+			dst += mesh.NumTri() * 50;
 		}
+	});
+}
+
+
+//OBJ and PLY
+
+// TextWriter: buffered output for the text formats.  Lines are written straight
+// into a 64K block that goes to the temp file as it fills, and close() commits it.
+
+class TextWriter
+{
+public:
+	TextWriter(const std::string& fname): filename(fname), tmpname(fname + ".tmp"), file(tmpname, std::ios::binary), buf(blockSize + lineMax) {}
+	~TextWriter();
+
+	char *begin() { return buf.data() + len; }  //where the next line goes, room for lineMax chars
+	void end(char *p);  //the line ended at p
+	bool close();
+
+	static const size_t lineMax = 512;
+
+private:
+	std::string filename, tmpname;
+	std::ofstream file;
+	std::vector<char> buf;
+	size_t len = 0;
+	bool closed = false;
+
+	static const size_t blockSize = 1 << 16;
+};
+
+TextWriter::~TextWriter()
+{
+	if (!closed) {  //abandoned before close(), don't leave the partial file behind
+		file.close();
+		remove(tmpname.c_str());
 	}
+}
 
-	manifold::MeshGL mesh;
-	mesh.vertProperties = std::move(positions);
-	//mesh.vertNormal = std::move(normals);
-	mesh.triVerts = std::move(indices);
-	return mesh;
+void TextWriter::end(char *p)
+{
+	len = p - buf.data();
+	if (len >= blockSize) {
+		file.write(buf.data(), len);
+		len = 0;
+	}
+}
+
+bool TextWriter::close()
+{
+	file.write(buf.data(), len);
+	file.close();
+	closed = true;
+	return commitTemp(tmpname, filename, !file.fail());
+}
+
+static char *put(char *p, const char *s)
+{
+	size_t l = strlen(s);
+	memcpy(p, s, l);
+	return p + l;
+}
+
+static char *putint(char *p, uint64_t i)
+{
+	return std::to_chars(p, p + 20, i).ptr;
 }
 
 // -----------------------------
-// Binary STL Loader
+// OBJ
 // -----------------------------
-manifold::MeshGL LoadBinary_STL(const std::string& filename) {
-	std::ifstream file(filename, std::ios::binary);
-	if (!file) throw std::runtime_error("Cannot open binary STL");
-
-	file.seekg(80); // skip header
+// Each mesh is an 'o' object of 'v' and triangular 'f' lines; OBJ indices are 
+// 1-based and count across the whole file.
+bool ExportMeshesOBJ(const std::string& filename, const std::vector<manifold::Manifold>& meshes, int precision)
+{
+	TextWriter out(filename);
+	char *p = out.begin();
+	p = put(p, "# cadsh\n");
+	out.end(p);
+
+	uint64_t base = 1;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		manifold::MeshGL mesh = meshes[i].GetMeshGL();
+		p = put(out.begin(), "o mesh");
+		p = putint(p, i + 1);
+		*p++ = '\n';
+		out.end(p);
+		for (size_t v = 0; v < mesh.NumVert(); v++) {
+			const float *x = &mesh.vertProperties[v * mesh.numProp];
+			p = put(out.begin(), "v ");
+			p = formatFloat(p, x[0], precision);
+			*p++ = ' ';
+			p = formatFloat(p, x[1], precision);
+			*p++ = ' ';
+			p = formatFloat(p, x[2], precision);
+			*p++ = '\n';
+			out.end(p);
+		}
+		for (size_t t = 0; t < mesh.NumTri(); t++) {
+			p = put(out.begin(), "f ");
+			p = putint(p, base + mesh.triVerts[t * 3]);
+			*p++ = ' ';
+			p = putint(p, base + mesh.triVerts[t * 3 + 1]);
+			*p++ = ' ';
+			p = putint(p, base + mesh.triVerts[t * 3 + 2]);
+			*p++ = '\n';
+			out.end(p);
+		}
+		base += mesh.NumVert();
+	}
+	return out.close();
+}
 
-	uint32_t triCount;
-	file.read(reinterpret_cast<char*>(&triCount), 4);
+// Reads the v and f lines, one MeshGL per 'o' object; faces of more than three 
+// vertices are fanned into triangles, and texture/normal references (v/vt/vn) and 
+// everything else are passed over.  Each object gets just the vertices its faces 
+// use, numbered in order of first use.
+std::vector<manifold::MeshGL> ImportMeshesOBJ(const std::string& filename)
+{
+	MappedFile file;
+	if (!file.open(filename)) throw std::runtime_error("Cannot open OBJ");
+	const char *p = file.data(), *e = file.data() + file.size();
 
 	std::vector<float> positions;
-	std::vector<float> normals;
-	std::vector<uint32_t> indices;
+	std::vector<uint32_t> faces;  //the current object's triangles, file-wide vertex indices
+	std::vector<manifold::MeshGL> meshes;
+	positions.reserve(file.size() / 40 * 3);
 
-	positions.reserve(triCount * 9);
-	normals.reserve(triCount * 9);
-	indices.reserve(triCount * 3);
-	
-	float weldEpsilon = 1e-5f;   // tweak as needed
-	std::unordered_map<QuantizedVec3, uint32_t, QuantizedHash> vertMap;
-
-	auto addVertex = [&](const Vec3& v, const Vec3& n) {
-		QuantizedVec3 key = Quantize(v, weldEpsilon);
+	auto blank = [&]() {
+		while (p < e && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	};
+	auto fail = [&](const char *what) {
+		throw std::runtime_error(std::string("OBJ: ") + what + " at byte " + std::to_string(p - file.data()));
+	};
 
-		auto it = vertMap.find(key);
-		if (it != vertMap.end()) {
-			return it->second;   // welded match
+	//file-wide vertex -> the current object's vertex; kept between objects, and only the 
+	//entries an object touched are reset, so many small objects don't cost a full pass each:
+	const uint32_t unused = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> local;
+
+	auto object = [&]() {  //the current object's faces become a MeshGL
+		if (faces.empty()) return;
+		local.resize(positions.size() / 3, unused);
+		manifold::MeshGL mesh;
+		mesh.triVerts.resize(faces.size());
+		for (size_t i = 0; i < faces.size(); i++) {
+			uint32_t& l = local[faces[i]];
+			if (l == unused) {
+				l = mesh.vertProperties.size() / 3;
+				mesh.vertProperties.insert(mesh.vertProperties.end(), &positions[(size_t) faces[i] * 3], &positions[(size_t) faces[i] * 3] + 3);
+			}
+			mesh.triVerts[i] = l;
 		}
+		for (uint32_t v : faces) local[v] = unused;
+		meshes.push_back(std::move(mesh));
+		faces.clear();
+	};
 
-		uint32_t idx = positions.size() / 3;
+	while (p < e) {
+		blank();
+		const char *w = p;
+		while (p < e && !isSpace(*p)) p++;
+		if (is(w, p, "v")) {
+			for (int j = 0; j < 3; j++) {
+				float f;
+				blank();
+				const char *n = p;
+				while (p < e && !isSpace(*p)) p++;
+				if (number(n, p, f) != p) fail("bad vertex coordinate");
+				positions.push_back(f);
+			}
+		}
+		else if (is(w, p, "f")) {
+			const size_t first = faces.size();
+			size_t corners = 0;
+			for (;;) {
+				blank();
+				if (p == e || *p == '\n') break;
+				const char *n = p;
+				while (p < e && !isSpace(*p) && *p != '/') p++;
+				long long i = 0;
+				if (number(n, p, i) != p) fail("bad face index");
+				while (p < e && !isSpace(*p)) p++;  // /vt/vn
+				const long long count = positions.size() / 3;
+				i = i < 0 ? count + i : i - 1;
+				if (i < 0 || i >= count) fail("face index out of range");
+				if (corners++ >= 3) {  // fan: first, previous, this
+					faces.push_back(faces[first]);
+					faces.push_back(faces[faces.size() - 2]);
+				}
+				faces.push_back((uint32_t) i);
+			}
+			if (corners < 3) fail("face with fewer than three vertices");
+		}
+		else if (is(w, p, "o")) {
+			object();
+		}
+		while (p < e && *p != '\n') p++;  //the rest of the line (names, comments, w)
+		if (p < e) p++;
+	}
+	object();
+	return meshes;
+}
 
-		positions.push_back(v.x);
-		positions.push_back(v.y);
-		positions.push_back(v.z);
+// -----------------------------
+// PLY
+// -----------------------------
+// Written as one vertex element of float x,y,z and one face element of 
+// 'list uchar int vertex_indices', all meshes in the one file.  Binary 
+// (little-endian) is sized up front and filled in parallel through a mapping, 
+// like binary STL.
+bool ExportMeshesPLY(const std::string& filename, const std::vector<manifold::Manifold>& ms, bool ascii, int precision)
+{
+	std::vector<manifold::MeshGL> meshes;
+	uint64_t nverts = 0, ntris = 0;
+	for (auto &m : ms) {
+		meshes.push_back(m.GetMeshGL());
+		nverts += meshes.back().NumVert();
+		ntris += meshes.back().NumTri();
+	}
+	if (nverts > std::numeric_limits<uint32_t>::max()) return false;
+
+	std::string header = "ply\nformat ";
+	header += ascii ? "ascii" : "binary_little_endian";
+	header += " 1.0\ncomment cadsh\nelement vertex " + std::to_string(nverts) +
+		"\nproperty float x\nproperty float y\nproperty float z\nelement face " + std::to_string(ntris) +
+		"\nproperty list uchar int vertex_indices\nend_header\n";
+
+	if (ascii) {
+		TextWriter out(filename);
+		out.end(put(out.begin(), header.c_str()));
+		for (auto &mesh : meshes) {
+			for (size_t v = 0; v < mesh.NumVert(); v++) {
+				const float *x = &mesh.vertProperties[v * mesh.numProp];
+				char *p = formatFloat(out.begin(), x[0], precision);
+				*p++ = ' ';
+				p = formatFloat(p, x[1], precision);
+				*p++ = ' ';
+				p = formatFloat(p, x[2], precision);
+				*p++ = '\n';
+				out.end(p);
+			}
+		}
+		uint64_t base = 0;
+		for (auto &mesh : meshes) {
+			for (size_t t = 0; t < mesh.NumTri(); t++) {
+				char *p = put(out.begin(), "3 ");
+				p = putint(p, base + mesh.triVerts[t * 3]);
+				*p++ = ' ';
+				p = putint(p, base + mesh.triVerts[t * 3 + 1]);
+				*p++ = ' ';
+				p = putint(p, base + mesh.triVerts[t * 3 + 2]);
+				*p++ = '\n';
+				out.end(p);
+			}
+			base += mesh.NumVert();
+		}
+		return out.close();
+	}
 
-		normals.push_back(n.x);
-		normals.push_back(n.y);
-		normals.push_back(n.z);
+	return ExportMapped(filename, header.size() + nverts * 12 + ntris * 13, [&](char *dst) {
+		memcpy(dst, header.data(), header.size());
+		char *vdst = dst + header.size();
+		char *fdst = vdst + nverts * 12;
+		const size_t chunk = 65536;
+		uint32_t base = 0;
+		for (auto &mesh : meshes) {
+			const size_t nv = mesh.NumVert(), nt = mesh.NumTri(), np = mesh.numProp;
+			if (np == 3)
+				memcpy(vdst, mesh.vertProperties.data(), nv * 12);
+			else
+				parallelFor((nv + chunk - 1) / chunk, [&](size_t c) {
+					for (size_t v = c * chunk; v < std::min(nv, (c + 1) * chunk); v++)
+						memcpy(vdst + v * 12, &mesh.vertProperties[v * np], 12);
+				});
+			parallelFor((nt + chunk - 1) / chunk, [&](size_t c) {
+				for (size_t t = c * chunk; t < std::min(nt, (c + 1) * chunk); t++) {
+					char *rec = fdst + t * 13;
+					uint32_t tri[3] = {base + mesh.triVerts[t * 3], base + mesh.triVerts[t * 3 + 1], base + mesh.triVerts[t * 3 + 2]};
+					rec[0] = 3;
+					memcpy(rec + 1, tri, 12);
+				}
+			});
+			vdst += nv * 12;
+			fdst += nt * 13;
+			base += nv;
+		}
+	});
+}
 
-		vertMap[key] = idx;
-		return idx;
-	};
+//PLY scalar types, by every name the spec and common writers use:
+struct PLYType { const char *name; int size; char kind; };
+static const PLYType plyTypes[] = {
+	{"char", 1, 'i'}, {"int8", 1, 'i'}, {"uchar", 1, 'u'}, {"uint8", 1, 'u'},
+	{"short", 2, 'i'}, {"int16", 2, 'i'}, {"ushort", 2, 'u'}, {"uint16", 2, 'u'},
+	{"int", 4, 'i'}, {"int32", 4, 'i'}, {"uint", 4, 'u'}, {"uint32", 4, 'u'},
+	{"float", 4, 'f'}, {"float32", 4, 'f'}, {"double", 8, 'f'}, {"float64", 8, 'f'}
+};
 
+static const PLYType *plyType(const std::string& name)
+{
+	for (const PLYType& t : plyTypes)
+		if (name == t.name) return &t;
+	throw std::runtime_error("PLY: unknown property type " + name);
+}
 
-	for (uint32_t i = 0; i < triCount; i++) {
-		Vec3 n, v1, v2, v3;
-		file.read((char*)&n, 12);
-		file.read((char*)&v1, 12);
-		file.read((char*)&v2, 12);
-		file.read((char*)&v3, 12);
+struct PLYProperty {
+	std::string name;
+	const PLYType *type;
+	const PLYType *count;  //list properties only, else NULL
+};
 
-		uint32_t i1 = addVertex(v1, n);
-		uint32_t i2 = addVertex(v2, n);
-		uint32_t i3 = addVertex(v3, n);
+struct PLYElement {
+	std::string name;
+	uint64_t count;
+	std::vector<PLYProperty> props;
+};
 
-		indices.push_back(i1);
-		indices.push_back(i2);
-		indices.push_back(i3);
+//the fewest bytes a record of el can take: binary, each property's size (a list 
+//just its count, but list f, the face indices, three entries); ASCII, a character 
+//and a separator per value:
+static uint64_t plyMinRecord(const PLYElement& el, bool ascii, int f = -1)
+{
+	uint64_t n = 0;
+	for (size_t i = 0; i < el.props.size(); i++) {
+		const PLYProperty& q = el.props[i];
+		const uint64_t items = q.count ? ((int) i == f ? 3 : 0) : 1;
+		if (ascii) n += 2 * (items + (q.count ? 1 : 0));
+		else n += (q.count ? q.count->size : 0) + items * q.type->size;
+	}
+	return n;
+}
 
-		file.seekg(2, std::ios::cur); // skip attribute bytes
+// Reads the vertex x,y,z and the face vertex_indices (fanned into triangles) of 
+// an ASCII or binary PLY; any other elements and properties are passed over.  
+// The indices are kept as they are, there's nothing to weld.  In little-endian 
+// binary, a vertex element of just float x,y,z is copied into vertProperties 
+// in one go, and triangles in 'uchar int' lists are decoded a record at a time.
+// An element count the rest of the file can't hold is refused before anything 
+// is allocated for it, and only binary bodies are sized from the header.
+manifold::MeshGL ImportMeshPLY(const std::string& filename)
+{
+	MappedFile file;
+	if (!file.open(filename)) throw std::runtime_error("Cannot open PLY");
+	const char *p = file.data(), *e = file.data() + file.size();
+
+	// header:
+	std::vector<PLYElement> elements;
+	enum { ascii, little, big } format = ascii;
+	bool magic = false, header = true;
+	while (header) {
+		const char *l = p;
+		while (p < e && *p != '\n') p++;
+		if (p == e) throw std::runtime_error("PLY: no end_header");
+		std::istringstream line(std::string(l, p++));
+		std::string word;
+		line >> word;
+		if (!magic) {
+			if (word != "ply") throw std::runtime_error("PLY: not a PLY file");
+			magic = true;
+		}
+		else if (word == "format") {
+			line >> word;
+			if (word == "ascii") format = ascii;
+			else if (word == "binary_little_endian") format = little;
+			else if (word == "binary_big_endian") format = big;
+			else throw std::runtime_error("PLY: unknown format " + word);
+		}
+		else if (word == "element") {
+			PLYElement el;
+			if (!(line >> el.name >> el.count)) throw std::runtime_error("PLY: bad element line");
+			elements.push_back(el);
+		}
+		else if (word == "property") {
+			if (elements.empty()) throw std::runtime_error("PLY: property before any element");
+			PLYProperty pr;
+			line >> word;
+			if (word == "list") {
+				std::string count, type;
+				line >> count >> type;
+				pr.count = plyType(count);
+				pr.type = plyType(type);
+			}
+			else {
+				pr.count = NULL;
+				pr.type = plyType(word);
+			}
+			line >> pr.name;
+			elements.back().props.push_back(pr);
+		}
+		else if (word == "end_header") header = false;
 	}
 
+	// body:
+	const bool swap = format == big;
+	auto value = [&](const PLYType *t) -> double {
+		if (format == ascii) {
+			while (p < e && isSpace(*p)) p++;
+			const char *n = p;
+			while (p < e && !isSpace(*p)) p++;
+			double v;
+			if (number(n, p, v) != p) throw std::runtime_error("PLY: bad number at byte " + std::to_string(n - file.data()));
+			return v;
+		}
+		if (p + t->size > e) throw std::runtime_error("PLY: truncated");
+		unsigned char b[8];
+		memcpy(b, p, t->size);
+		p += t->size;
+		if (swap) std::reverse(b, b + t->size);
+		switch (t->kind) {
+			case 'f': {
+				if (t->size == 4) { float f; memcpy(&f, b, 4); return f; }
+				double d; memcpy(&d, b, 8); return d;
+			}
+			case 'i': {
+				if (t->size == 1) return (int8_t) b[0];
+				if (t->size == 2) { int16_t i; memcpy(&i, b, 2); return i; }
+				int32_t i; memcpy(&i, b, 4); return i;
+			}
+			default: {
+				if (t->size == 1) return b[0];
+				if (t->size == 2) { uint16_t i; memcpy(&i, b, 2); return i; }
+				uint32_t i; memcpy(&i, b, 4); return i;
+			}
+		}
+	};
+
+	auto fits = [&](const PLYElement& el, int f = -1) {
+		const uint64_t min = plyMinRecord(el, format == ascii, f);
+		if (min > 0 && el.count > ((uint64_t) (e - p) + (format == ascii)) / min)
+			throw std::runtime_error("PLY: truncated, " + std::to_string(el.count) + " " + el.name + " records don't fit");
+	};
+
 	manifold::MeshGL mesh;
-	mesh.vertProperties = std::move(positions);
-	//mesh.vertNormal = std::move(normals);
-	mesh.triVerts = std::move(indices);
+	uint64_t nverts = 0;
+	for (const PLYElement& el : elements) {
+		const auto& pr = el.props;
+		if (el.name == "vertex") {
+			if (el.count > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("PLY: too many vertices");
+			nverts = el.count;
+			int x = -1, y = -1, z = -1;
+			for (size_t i = 0; i < pr.size(); i++) {
+				if (pr[i].name == "x") x = i;
+				if (pr[i].name == "y") y = i;
+				if (pr[i].name == "z") z = i;
+			}
+			if (x < 0 || y < 0 || z < 0) throw std::runtime_error("PLY: vertex has no x, y and z");
+			fits(el);
+
+			if (format == little && pr.size() == 3 && x == 0 && y == 1 && z == 2 && 
+					pr[0].type->kind == 'f' && pr[0].type->size == 4 && pr[1].type == pr[0].type && pr[2].type == pr[0].type) {
+				mesh.vertProperties.resize(el.count * 3);
+				memcpy(mesh.vertProperties.data(), p, el.count * 12);
+				p += el.count * 12;
+				continue;
+			}
+			if (format != ascii) mesh.vertProperties.reserve(el.count * 3);
+			for (uint64_t v = 0; v < el.count; v++) {
+				float xyz[3] = {0, 0, 0};
+				for (size_t i = 0; i < pr.size(); i++) {
+					size_t n = pr[i].count ? (size_t) value(pr[i].count) : 1;
+					for (size_t k = 0; k < n; k++) {
+						double d = value(pr[i].type);
+						if ((int) i == x) xyz[0] = d;
+						else if ((int) i == y) xyz[1] = d;
+						else if ((int) i == z) xyz[2] = d;
+					}
+				}
+				mesh.vertProperties.insert(mesh.vertProperties.end(), xyz, xyz + 3);
+			}
+		}
+		else if (el.name == "face") {
+			int f = -1;
+			for (size_t i = 0; i < pr.size(); i++)
+				if (pr[i].count && (pr[i].name == "vertex_indices" || pr[i].name == "vertex_index")) f = i;
+			if (f < 0) throw std::runtime_error("PLY: face has no vertex_indices");
+			fits(el, f);
+			if (format != ascii) mesh.triVerts.reserve(el.count * 3);
+
+			const bool fast = format == little && pr.size() == 1 && pr[0].count->size == 1 && pr[0].type->size == 4 && pr[0].type->kind != 'f';
+			for (uint64_t t = 0; t < el.count; t++) {
+				if (fast && p + 13 <= e && *p == 3) {
+					uint32_t tri[3];
+					memcpy(tri, p + 1, 12);
+					p += 13;
+					if (tri[0] >= nverts || tri[1] >= nverts || tri[2] >= nverts) throw std::runtime_error("PLY: face index out of range");
+					mesh.triVerts.insert(mesh.triVerts.end(), tri, tri + 3);
+					continue;
+				}
+				for (size_t i = 0; i < pr.size(); i++) {
+					size_t n = pr[i].count ? (size_t) value(pr[i].count) : 1;
+					const size_t first = mesh.triVerts.size();
+					for (size_t k = 0; k < n; k++) {
+						double d = value(pr[i].type);
+						if ((int) i != f) continue;
+						if (d < 0 || d >= nverts) throw std::runtime_error("PLY: face index out of range");
+						if (k >= 3) {  // fan: first, previous, this
+							mesh.triVerts.push_back(mesh.triVerts[first]);
+							mesh.triVerts.push_back(mesh.triVerts[mesh.triVerts.size() - 2]);
+						}
+						mesh.triVerts.push_back((uint32_t) d);
+					}
+					if ((int) i == f && n < 3) throw std::runtime_error("PLY: face with fewer than three vertices");
+				}
+			}
+		}
+		else {
+			fits(el);
+			for (uint64_t v = 0; v < el.count; v++)
+				for (const PLYProperty& q : pr) {
+					size_t n = q.count ? (size_t) value(q.count) : 1;
+					for (size_t k = 0; k < n; k++) value(q.type);
+				}
+		}
+	}
 	return mesh;
 }
 
 // -----------------------------
-// Unified Loader
+// cmesh
 // -----------------------------
-manifold::MeshGL LoadSTL_Dedup(const std::string& filename) {
-	if (IsASCII_STL(filename))
-		return LoadASCII_STL(filename);
-	else
-		return LoadBinary_STL(filename);
+// cadsh's own cache format, each MeshGL's arrays exactly as they are in memory, 
+// so a load is little more than copying out of the mapping:
+//   file: 8-byte magic "cmesh\0\0\1", uint32 byte-order mark 0x01020304, uint32 mesh count
+//   mesh: uint32 numProp, float tolerance, a uint64 length for each of the nine arrays,
+//         then the arrays, each zero-padded to a multiple of 8 bytes
+// Every array holds 4-byte floats or uint32s; the format is the machine's (little-endian 
+// everywhere cadsh builds), and a file from the other byte order is refused.
+
+static const char cmeshMagic[8] = {'c', 'm', 'e', 's', 'h', 0, 0, 1};
+static const uint32_t cmeshOrder = 0x01020304;
+
+//f(array) for each MeshGL array, in file order:
+template<class M, class F>
+static void cmeshArrays(M& mesh, F f)
+{
+	f(mesh.vertProperties);
+	f(mesh.triVerts);
+	f(mesh.mergeFromVert);
+	f(mesh.mergeToVert);
+	f(mesh.runIndex);
+	f(mesh.runOriginalID);
+	f(mesh.runTransform);
+	f(mesh.faceID);
+	f(mesh.halfedgeTangent);
 }
 
-manifold::MeshGL ImportMeshSTL(const std::string& filename)
+static uint64_t cmeshPadded(uint64_t bytes)
 {
-	manifold::MeshGL mesh = LoadSTL_Dedup(filename);
-	return mesh;
+	return (bytes + 7) / 8 * 8;
 }
 
-bool ExportMeshSTL(const std::string& filename, const manifold::MeshGL& mesh)
+bool ExportMeshesCMesh(const std::string& filename, const std::vector<manifold::Manifold>& ms)
 {
-	const uint64_t numBytes = mesh.NumTri() * 50 + 84;
-    char *dst = (char *)calloc(numBytes, 1);
+	std::vector<manifold::MeshGL> meshes;
+	uint64_t size = 16;
+	for (auto &m : ms) {
+		meshes.push_back(m.GetMeshGL());
+		size += 8;
+		cmeshArrays(meshes.back(), [&](const auto& a) { size += 8 + cmeshPadded(a.size() * 4); });
+	}
 
-	const uint32_t count = mesh.NumTri();
-    memcpy(dst + 80, &count, 4);
-	
-	for (size_t i = 0; i < mesh.NumTri(); ++i) {
-		uint32_t t[3];
-		for (int j : {0, 1, 2}) t[j] = mesh.triVerts[3 * i + j];
-		float p0[3];
-		for (int j : {0, 1, 2}) p0[j] = mesh.vertProperties[t[0] * mesh.numProp + j];
-		float p1[3];
-		for (int j : {0, 1, 2}) p1[j] = mesh.vertProperties[t[1] * mesh.numProp + j];
-		float p2[3];
-		for (int j : {0, 1, 2}) p2[j] = mesh.vertProperties[t[2] * mesh.numProp + j];
-		
-		float n[3], u[3], v[3];
-	
-		u[0] = p1[0] - p0[0];
-		u[1] = p1[1] - p0[1];
-		u[2] = p1[2] - p0[2];
-	
-		v[0] = p2[0] - p0[0];
-		v[1] = p2[1] - p0[1];
-		v[2] = p2[2] - p0[2];
-	
-		n[0] = u[1]*v[2] - u[2]*v[1];
-		n[1] = u[2]*v[0] - u[0]*v[2];
-		n[2] = u[0]*v[1] - u[1]*v[0];
-	
-		double l = sqrt(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
-		n[0] = n[0]/l;
-		n[1] = n[1]/l;
-		n[2] = n[2]/l;
-		
-		float normal[3] = {n[0], n[1], n[2]};
-
-        const uint64_t idx = 84 + i * 50;
-        memcpy(dst + idx, &normal, 12);
-        memcpy(dst + idx + 12, &p0, 12);
-        memcpy(dst + idx + 24, &p1, 12);
-        memcpy(dst + idx + 36, &p2, 12);
-    }
-
-    std::fstream file(filename, std::ios::out | std::ios::binary);
-    file.write(dst, numBytes);
-    file.close();
-
-    free(dst);
-	return true;
+	return ExportMapped(filename, size, [&](char *dst) {
+		const uint32_t count = meshes.size();
+		memcpy(dst, cmeshMagic, 8);
+		memcpy(dst + 8, &cmeshOrder, 4);
+		memcpy(dst + 12, &count, 4);
+		dst += 16;
+		for (auto &mesh : meshes) {
+			memcpy(dst, &mesh.numProp, 4);
+			memcpy(dst + 4, &mesh.tolerance, 4);
+			dst += 8;
+			cmeshArrays(mesh, [&](const auto& a) {
+				const uint64_t length = a.size();
+				memcpy(dst, &length, 8);
+				dst += 8;
+			});
+			cmeshArrays(mesh, [&](const auto& a) {  //the padding is already zero, the file was created empty
+				memcpy(dst, a.data(), a.size() * 4);
+				dst += cmeshPadded(a.size() * 4);
+			});
+		}
+	});
+}
+
+std::vector<manifold::Manifold> ImportMeshesCMesh(const std::string& filename)
+{
+	MappedFile file;
+	if (!file.open(filename)) throw std::runtime_error("Cannot open cmesh");
+	const char *p = file.data(), *e = file.data() + file.size();
+	auto need = [&](uint64_t n) {
+		if ((uint64_t) (e - p) < n) throw std::runtime_error("cmesh: truncated");
+	};
+
+	need(16);
+	uint32_t order, count;
+	memcpy(&order, p + 8, 4);
+	memcpy(&count, p + 12, 4);
+	if (memcmp(p, cmeshMagic, 8) != 0) throw std::runtime_error("cmesh: not a cmesh file");
+	if (order != cmeshOrder) throw std::runtime_error("cmesh: written with the other byte order");
+	p += 16;
+
+	//each mesh takes at least its 80-byte header, so a count the file can't hold is refused before allocating:
+	if (count > (uint64_t) (e - p) / (8 + 9 * 8)) throw std::runtime_error("cmesh: truncated, " + std::to_string(count) + " meshes don't fit");
+	std::vector<manifold::MeshGL> meshes(count);
+	for (auto &mesh : meshes) {
+		need(8 + 9 * 8);
+		memcpy(&mesh.numProp, p, 4);
+		memcpy(&mesh.tolerance, p + 4, 4);
+		p += 8;
+		uint64_t lengths[9];
+		memcpy(lengths, p, sizeof(lengths));
+		p += sizeof(lengths);
+		int i = 0;
+		cmeshArrays(mesh, [&](auto& a) {
+			const uint64_t length = lengths[i++];
+			if (length > (uint64_t) (e - p) / 4) throw std::runtime_error("cmesh: truncated");
+			need(cmeshPadded(length * 4));
+			a.resize(length);
+			memcpy(a.data(), p, length * 4);
+			p += cmeshPadded(length * 4);
+		});
+	}
+	file.close();
+
+	//as with 3MF, the Manifolds are validated concurrently:
+	std::vector<manifold::Manifold> ms(count);
+	parallelFor(count, [&](size_t i) {
+		ms[i] = manifold::Manifold(meshes[i]);
+		meshes[i] = manifold::MeshGL();
+	});
+	return ms;
 }
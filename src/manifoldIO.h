@@ -4,9 +4,34 @@
 #include "manifold/manifold.h"
 
 //STL routines:
-manifold::MeshGL ImportMeshSTL(const std::string& filename);
+struct ImportSTLOptions {
+	float weld = 1e-5f;  //corners in the same weld-sized cell become one vertex; 0 welds only identical positions
+	bool normals = false;  //vertex normals (the normalized sum of the facet normals around each vertex) as properties 3-5 (numProp=6)
+	bool stream = false;  //weld triangle by triangle as the file is read, holding only the mesh being built
+};
+
+manifold::MeshGL ImportMeshSTL(const std::string& filename, const ImportSTLOptions& opt = ImportSTLOptions());
 
 bool ExportMeshSTL(const std::string& filename, const manifold::MeshGL& mesh);
+bool ExportMeshesSTL(const std::string& filename, const std::vector<manifold::Manifold>& meshes);
+
+
+//OBJ routines:
+std::vector<manifold::MeshGL> ImportMeshesOBJ(const std::string& filename);
+
+bool ExportMeshesOBJ(const std::string& filename, const std::vector<manifold::Manifold>& meshes, int precision = -1);
+
+
+//PLY routines:
+manifold::MeshGL ImportMeshPLY(const std::string& filename);
+
+bool ExportMeshesPLY(const std::string& filename, const std::vector<manifold::Manifold>& meshes, bool ascii = false, int precision = -1);
+
+
+//cmesh (cadsh's native binary cache) routines:
+std::vector<manifold::Manifold> ImportMeshesCMesh(const std::string& filename);
+
+bool ExportMeshesCMesh(const std::string& filename, const std::vector<manifold::Manifold>& meshes);
 
 
 //3MF routines:
@@ -14,10 +39,16 @@ manifold::Manifold ImportMesh3MF(const std::string& filename);
 
 std::vector<manifold::Manifold> ImportMeshes3MF(const std::string& filename);
 
-bool ExportMesh3MF(const std::string& filename, const manifold::Manifold& mesh);
-bool ExportMeshGL3MF(const std::string& filename, const manifold::MeshGL &mesh);
+struct Export3MFOptions {
+	int precision = -1;  //decimals written per coordinate, -1 = shortest string that round-trips the float
+	int level = 10;  //deflate level, 0 (store) to 10 (best)
+	bool parallel = false;  //deflate the model document on all threads; holds the compressed document in memory
+};
+
+bool ExportMesh3MF(const std::string& filename, const manifold::Manifold& mesh, const Export3MFOptions& opt = Export3MFOptions());
+bool ExportMeshGL3MF(const std::string& filename, const manifold::MeshGL &mesh, const Export3MFOptions& opt = Export3MFOptions());
 				
-bool ExportMeshes3MF(const std::string& filename, const std::vector<manifold::Manifold> meshes);
+bool ExportMeshes3MF(const std::string& filename, const std::vector<manifold::Manifold> meshes, const Export3MFOptions& opt = Export3MFOptions());
 
 inline std::string manifoldError(const manifold::Manifold::Error& error) {
   switch (error) {
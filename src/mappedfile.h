@@ -0,0 +1,164 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <string>
+#include <cstddef>
+#include <algorithm>
+
+#ifdef _WIN32
+//keep windows.h's min/max macros out of std::min and numeric_limits<>::max in the includers:
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//A whole file mapped into memory, either read-only (open) or as a new file of a
+//size fixed up front (create).  The mapping goes away with close() or the object;
+//the page cache does the I/O, so nothing is read or written until it's touched.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& filename);
+	bool create(const std::string& filename, size_t size);
+	void close();
+
+	//hint that offset..offset+length of a read-only mapping won't be needed again, so 
+	//its pages can go back to the system; a later access reads them in again:
+	void discard(size_t offset, size_t length);
+
+	char *data() { return ptr; }
+	const char *data() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	char *ptr = nullptr;
+	size_t len = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	bool map(DWORD protect, DWORD access);
+#else
+	int fd = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+inline bool MappedFile::map(DWORD protect, DWORD access)
+{
+	if (len == 0) return true;
+	mapping = CreateFileMappingA(file, NULL, protect, (DWORD) ((unsigned long long) len >> 32), (DWORD) len, NULL);
+	if (mapping == NULL) return false;
+	ptr = (char *) MapViewOfFile(mapping, access, 0, 0, len);
+	return ptr != NULL;
+}
+
+inline bool MappedFile::open(const std::string& filename)
+{
+	close();
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER s;
+	if (!GetFileSizeEx(file, &s)) { close(); return false; }
+	len = (size_t) s.QuadPart;
+	if (!map(PAGE_READONLY, FILE_MAP_READ)) { close(); return false; }
+	return true;
+}
+
+inline bool MappedFile::create(const std::string& filename, size_t size)
+{
+	close();
+	file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	len = size;
+	if (!map(PAGE_READWRITE, FILE_MAP_WRITE)) { close(); return false; }
+	return true;
+}
+
+inline void MappedFile::discard(size_t, size_t)
+{
+	//the page cache trims clean file pages on its own
+}
+
+inline void MappedFile::close()
+{
+	if (ptr) UnmapViewOfFile(ptr);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	ptr = nullptr;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+	len = 0;
+}
+
+#else
+
+inline bool MappedFile::open(const std::string& filename)
+{
+	close();
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1) return false;
+	struct stat s;
+	if (fstat(fd, &s) == -1) { close(); return false; }
+	len = (size_t) s.st_size;
+	if (len == 0) return true;
+	void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) { close(); return false; }
+	ptr = (char *) p;
+	madvise(ptr, len, MADV_SEQUENTIAL);
+	return true;
+}
+
+inline bool MappedFile::create(const std::string& filename, size_t size)
+{
+	close();
+	fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) return false;
+	if (ftruncate(fd, (off_t) size) == -1) { close(); return false; }
+#ifdef __linux__
+	//reserve the blocks now; a full disk found later would be a SIGBUS on a store to the mapping:
+	int r = posix_fallocate(fd, 0, (off_t) size);
+	if (r != 0 && r != EINVAL && r != EOPNOTSUPP) { close(); return false; }
+#endif
+	len = size;
+	if (len == 0) return true;
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) { close(); return false; }
+	ptr = (char *) p;
+	return true;
+}
+
+inline void MappedFile::discard(size_t offset, size_t length)
+{
+	const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t b = (offset + page - 1) / page * page, e = std::min(offset + length, len) / page * page;  // whole pages only
+	if (ptr && b < e) madvise(ptr + b, e - b, MADV_DONTNEED);
+}
+
+inline void MappedFile::close()
+{
+	if (ptr) munmap(ptr, len);
+	if (fd != -1) ::close(fd);
+	ptr = nullptr;
+	fd = -1;
+	len = 0;
+}
+
+#endif
+
+#endif
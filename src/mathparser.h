@@ -88,7 +88,7 @@ public:
 	void dumpStack()
 	{
 		for (std::vector<float>::iterator it = s.begin(); it != s.end(); ++it)
-			std::cout << *it << std::endl;
+			std::cout << *it << "\n";
 	}
 
 private:
@@ -129,8 +129,12 @@ public:
 		unsigned m=n;
 
 		if (isspace(s[m])) {
-			while (isspace(s[n]))
+			while (isspace(s[m]))
 				m++;
+			if (m >= l) {
+				if (advance) n = m;
+				return (token) {S_end, "", 0.0};
+			}
 		}
 
 		if (s[m] == '+') {
@@ -181,13 +185,24 @@ public:
 				t.sval.push_back(s[m]);
 				m++;
 			}
+			//exponent, e.g. 1e-3:
+			if (m+1 < l && (s[m] == 'e' || s[m] == 'E')) {
+				unsigned d = (s[m+1] == '+' || s[m+1] == '-') ? m+2 : m+1;
+				if (d < l && isdigit(s[d])) {
+					while (m < d) t.sval.push_back(s[m++]);
+					while (isdigit(s[m])) {
+						t.sval.push_back(s[m]);
+						m++;
+					}
+				}
+			}
 			t.dval = atof(t.sval.c_str());
 			t.toktype = T_num;
 		}
 		else {
 			t.toktype = T_unknown;
 			t.sval.push_back(s[m]);
-			n++;
+			m++;  //only consumed when advancing, so peekToken() doesn't skip it
 		}
 
 		if (advance) n = m;
@@ -232,6 +247,7 @@ public:
 		expr = expression;
 		l.setExpression(expression);
 		if (E("")) {
+			if (peekToken().toktype != S_end) return err("unexpected: "+expr.substr(getPos()));
 			answer = s.pop();
 			return true;
 		}
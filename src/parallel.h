@@ -0,0 +1,73 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <algorithm>
+
+//upper bound on the worker threads parallelFor() uses; 0 means one per hardware thread:
+inline unsigned& threadLimit()
+{
+	static unsigned limit = 0;
+	return limit;
+}
+
+inline unsigned threadCount(size_t jobs)
+{
+	unsigned n = threadLimit();
+	if (n == 0) n = std::thread::hardware_concurrency();
+	if (n == 0) n = 1;
+	return (unsigned) std::min<size_t>(n, jobs);
+}
+
+//set on the threads running a parallelFor's jobs (the calling thread included):
+inline bool& inParallelFor()
+{
+	static thread_local bool inside = false;
+	return inside;
+}
+
+//runs f(i) for every i in [0,n).  Indices are handed out one at a time from a 
+//shared counter, so jobs of uneven size (e.g. meshes) still keep every thread busy.
+//The first exception thrown by f is rethrown in the calling thread.  A parallelFor
+//called from inside another's jobs runs serially, so threadLimit() bounds the 
+//threads in use however the calls nest.
+template<class F>
+void parallelFor(size_t n, F f)
+{
+	unsigned nthreads = inParallelFor() ? 1 : threadCount(n);
+	if (nthreads <= 1) {
+		for (size_t i=0; i<n; i++) f(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::atomic<bool> failed(false);
+
+	auto worker = [&]() {
+		inParallelFor() = true;
+		size_t i;
+		while (!failed && (i = next++) < n) {
+			try {
+				f(i);
+			}
+			catch (...) {
+				if (!failed.exchange(true)) error = std::current_exception();
+			}
+		}
+		inParallelFor() = false;
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned t=1; t<nthreads; t++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto &t : threads) t.join();
+
+	if (error) std::rethrow_exception(error);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __WELDKEY_H__
+#define __WELDKEY_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+
+//The STL weld's vertex keys: a position quantized to its weld cell, and the hash
+//the weld tables are keyed on.  Shared by manifoldIO.cpp and cadsh_bench.
+
+struct Vec3 {
+	float x, y, z;
+	bool operator==(const Vec3& o) const {
+		return x == o.x && y == o.y && z == o.z;
+	}
+};
+
+struct QuantizedVec3 {
+	int64_t x, y, z;
+	bool operator==(const QuantizedVec3& o) const {
+		return x == o.x && y == o.y && z == o.z;
+	}
+};
+
+// the coordinates multiply-combined, then the murmur3 64-bit finalizer, so every 
+// bit of the hash depends on every coordinate; grid-aligned CAD vertices clustered 
+// in the low bits of the old XOR-of-products hash:
+struct QuantizedHash {
+	uint64_t operator()(const QuantizedVec3& q) const noexcept {
+		uint64_t h = (uint64_t) q.x;
+		h = h * 0x9E3779B97F4A7C15ull ^ (uint64_t) q.y;
+		h = h * 0x9E3779B97F4A7C15ull ^ (uint64_t) q.z;
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+};
+
+// the cell index of coordinate c; a weld tolerance so fine against the coordinate 
+// that the index won't fit 64 bits (or a non-finite coordinate) is an error rather 
+// than a collapsed key:
+inline int64_t QuantizeCoordinate(float c, float eps) {
+	const double q = std::floor((double) c / eps);
+	if (!(std::fabs(q) < 4.6e18)) {
+		char msg[80];
+		snprintf(msg, sizeof(msg), "weld %g too fine for coordinate %g", eps, c);
+		throw std::runtime_error(msg);
+	}
+	return (int64_t) q;
+}
+
+// eps 0 is an exact key, the float bits themselves (+0 standing in for -0), so 
+// only identical positions weld and none are split across a cell boundary:
+inline QuantizedVec3 Quantize(const Vec3& v, float eps) {
+	if (eps == 0.0f) {
+		const float c[3] = {v.x + 0.0f, v.y + 0.0f, v.z + 0.0f};
+		uint32_t b[3];
+		memcpy(b, c, sizeof(b));
+		return {b[0], b[1], b[2]};
+	}
+	return {
+		QuantizeCoordinate(v.x, eps),
+		QuantizeCoordinate(v.y, eps),
+		QuantizeCoordinate(v.z, eps)
+	};
+}
+
+#endif